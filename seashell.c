@@ -1,41 +1,187 @@
+#define _GNU_SOURCE
 #include <unistd.h>
+#include <fcntl.h>
 #include <sys/wait.h>  
 #include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/sendfile.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <termios.h> //termios, TCSANOW, ECHO, ICANON
 #include <string.h>
 #include <stdbool.h>
 #include <errno.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#include <time.h>
+#include <spawn.h>
+#include <signal.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/ioctl.h>
+#include <dirent.h>
+#include <poll.h>
+#include <regex.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <limits.h>
+#include <sys/socket.h>
 const char *sysname = "seashell";
+extern char **environ;
+int last_status; // exit status of the last foreground command
 
 
 //PATH USED FOR QUESTION 2
 char abspath[500];
-char namefile_path[500];
+char namefile_path[500];	// name.txt and path.txt are only read to import old associations
 char pathfile_path[500];
+char shortdir_db_path[500];
+char kdiff_cache_path[500];	// (dev, inode, mtime, size) -> digest of files compared by kdiff
+char history_path[500];	// $HOME/.seashell_history, empty when HOME is not set
 
 //METHODS DEFINED 
 
 //METHODS USED IN Q2
-int find_index(char* str1, char* fileName);
 void clear();
-void update_txt(int line_number, char *new_txt, char *file_name);
 void set_name(char *name, char *path);
 void delete(char *name);
 void list_associations();
-char* get_path(char *name);
+const char* get_path(char *name);
+void shortdir_refresh();
+void shortdir_compact();
+void shortdir_record_visit();
+const char *shortdir_find(char *query);
 
 //METHODS USED IN Q3
-char* to_lower_case(char* word);
-void print_colored_text(char *color, char*text);
+struct highlighter;
+struct outbuf;
+char *color_escape(const char *color);
 void highlight(char *word, char* color, char* file_name);
+void highlight_command(int argc, char *argv[]);
+int highlighter_add(struct highlighter *h, const char *pattern, const char *color, bool is_regex);
+void highlighter_compile(struct highlighter *h);
+void highlighter_free(struct highlighter *h);
+void highlight_file(struct highlighter *h, const char *file_name, int jobs);
+void highlight_chunk(struct highlighter *h, const char *text, size_t len, struct outbuf *out);
+int highlight_fd(struct highlighter *h, int fd, struct outbuf *out, int jobs);
+void outbuf_put(struct outbuf *out, const char *data, size_t len);
+void outbuf_flush(struct outbuf *out);
 
 //METHODS USED IN Q5
-void compare_txt_files(char *txt1, char *txt2);
-void compare_binary_files(char *file1_name, char *file2_name);
+void compare_txt_files(char *txt1, char *txt2, int algorithm, int context);
+void compare_binary_files(char *file1_name, char *file2_name, bool ranges);
+bool kdiff_same_content(const char *file1_name, const char *file2_name);
 //METHODS USED IN Q6
 void concatenate_txt_files(int argc, char *argv[]);
+
+//METHODS USED FOR PARSING
+struct command_t;
+struct arena;
+struct parse_state;
+void *arena_alloc(struct arena **arena, size_t size);
+void arena_release(struct arena *arena);
+void parse_finish_stage(struct command_t *command, char *empty);
+void parse_list(struct parse_state *st, struct command_t *list, int depth);
+int process_pipeline(struct command_t *command);
+void parse_benchmark(int megabytes);
+void bench_builtin(struct command_t *command);
+
+//METHODS USED FOR PIPELINES
+bool is_builtin(const char *name);
+int run_builtin(struct command_t *command);
+int run_pipeline(struct command_t *command);
+pid_t launch_stage(struct command_t *command, int in_fd, int out_fd, pid_t pgid);
+pid_t launch_argv(const char *path, char **argv, int in_fd, int out_fd, int strategy, pid_t pgid);
+char **build_argv(struct command_t *command);
+void spawn_benchmark(int count, char **argv);
+void exec_stage(struct command_t *command, const char *exec_path);
+bool zero_copy_eligible(struct command_t *command);
+bool try_zero_copy_stage(struct command_t *command);
+ssize_t copy_fd(int in_fd, int out_fd);
+int write_all(int fd, const char *buf, size_t len);
+int open_redirects(struct command_t *command, int redirect_fds[2]);
+int run_builtin_redirected(struct command_t *command, int redirect_fds[2]);
+
+//METHODS USED FOR BATCH MODE
+int run_batch(int fd);
+int run_batch_buffer(char *buf, size_t len);
+int run_batch_line(char *line);
+
+//METHODS USED FOR JOB CONTROL
+struct job;
+void sigchld_init();
+void job_control_init();
+void reset_child_signals();
+struct job *job_create(struct command_t *command, pid_t pgid, pid_t *pids, int count);
+void reap_children();
+void wait_for_job(struct job *job, bool foreground);
+bool job_is_done(struct job *job);
+int job_exit_status(struct job *job);
+void notify_jobs();
+void list_jobs();
+struct job *find_job(const char *spec);
+int job_builtin(struct command_t *command);
+void sigchld_handler(int sig);
+void job_update(pid_t pid, int status, struct rusage *ru);
+int parallel_builtin(struct command_t *command);
+
+//METHODS USED FOR THE HELPER POOL
+bool helper_eligible(struct command_t *command);
+pid_t helper_launch(struct command_t *command, int in_fd, int out_fd, pid_t pgid);
+bool helper_is_busy(pid_t pid);
+pid_t helper_reap(int *status, struct rusage *ru);
+int helper_poll_fds(struct pollfd *fds);
+void helper_reap_retired();
+void helper_pool_resize(int count);
+int helper_count();
+pid_t helper_pool_group();
+void helper_park(pid_t pid);
+void helper_pool_detach();
+void helper_close_inherited(int keep);
+void helper_builtin(struct command_t *command);
+
+//METHODS USED FOR THE PROMPT
+void prompt_format(char *out, size_t size);
+void prompt_cwd_changed();
+void prompt_request_git();
+
+//METHODS USED FOR THE LINE EDITOR
+char *line_edit(const char *prompt);
+void history_add(const char *line);
+struct line_editor;
+void line_complete(struct line_editor *ed);
+
+//METHODS USED FOR COMPLETION
+struct completion;
+struct dir_listing;
+void complete_word(struct completion *c, const char *line, size_t cursor);
+void completion_list(struct completion *c, struct outbuf *out);
+void completion_free(struct completion *c);
+size_t completion_common(struct completion *c);
+char *complete_unescape(const char *text, size_t len);
+char *complete_escape(const char *name, size_t len);
+
+//METHODS USED FOR STATS
+struct command_stat;
+struct command_stat *stats_record(const char *text, struct timespec *started, struct rusage *ru, int status);
+int stats_run_builtin(struct command_t *command, int redirect_fds[2]);
+size_t stats_count();
+void stats_print_time(size_t recorded);
+void stats_builtin(struct command_t *command);
+void rusage_delta(struct rusage *delta, struct rusage *before, struct rusage *after);
+
+//METHODS USED FOR PATH LOOKUP
+unsigned int hash_string(const char *str);
+void path_dirs_refresh();
+void hash_cache_refresh();
+const char *resolve_command(const char *name);
+void path_hash_clear();
+void path_hash_set(const char *path, const char *name);
+void path_hash_list(bool reusable);
 //------------------------------------------
 
 enum return_codes
@@ -43,6 +189,24 @@ enum return_codes
 	SUCCESS = 0,
 	EXIT = 1,
 	UNKNOWN = 2,
+	NOT_BUILTIN = 3,
+};
+enum diff_algorithm
+{
+	DIFF_MYERS = 0,
+	DIFF_HISTOGRAM = 1,
+};
+enum list_operator
+{
+	LIST_SEQ = 0, // ; and &, the next pipeline always runs
+	LIST_AND = 1, // &&, only after a success
+	LIST_OR = 2,  // ||, only after a failure
+};
+enum launch_strategy
+{
+	LAUNCH_SPAWN = 0,
+	LAUNCH_VFORK = 1,
+	LAUNCH_FORK = 2,
 };
 struct command_t
 {
@@ -53,7 +217,54 @@ struct command_t
 	char **args;
 	char *redirects[3];		// in/out redirection
 	struct command_t *next; // for piping
+	struct command_t *list_next; // next pipeline of a ; && || list, set on the first stage
+	int list_op;				 // how list_next runs, see enum list_operator
+	struct command_t *subshell;	 // ( list ) stage, run by a forked shell
+	struct arena *arena;	// owns the strings and piped commands of the whole line
 };
+// bump allocator, released in one call
+struct arena
+{
+	struct arena *next;
+	size_t used;
+	size_t size;
+	_Alignas(max_align_t) char data[]; // starts where malloc would, not right after size
+};
+// parser position shared by the nested lists of one line
+struct parse_state
+{
+	const char *p;
+	const char *end;
+	char *out; // next free byte for words
+	struct arena **arena;
+};
+// job table, every pipeline is a job keyed by its process group
+struct job_process
+{
+	pid_t pid;
+	int status;
+	bool done;
+	bool stopped;
+	bool helper; // a builtin stage run by a helper, see helper_launch
+};
+
+struct job
+{
+	int id;
+	pid_t pgid;
+	char *text;
+	struct job_process *procs;
+	int proc_count;
+	bool background;
+	struct rusage usage; // summed over all processes of the job
+	struct timespec started;
+	struct job *next;
+};
+
+struct job *job_list;
+int sigchld_pipe[2] = {-1, -1};
+bool job_control;	// interactive shell, jobs get their own process group and the terminal
+pid_t shell_pgid;
 /**
  * Prints a command struct
  * @param struct command_t *
@@ -78,173 +289,268 @@ void print_command(struct command_t *command)
 }
 /**
  * Release allocated memory of a command
+ * Everything parse_command created lives in the arena of the first command.
  * @param  command [description]
  * @return         [description]
  */
 int free_command(struct command_t *command)
 {
-	if (command->arg_count)
-	{
-		for (int i = 0; i < command->arg_count; ++i)
-			free(command->args[i]);
-		free(command->args);
-	}
-	for (int i = 0; i < 3; ++i)
-		if (command->redirects[i])
-			free(command->redirects[i]);
-	if (command->next)
-	{
-		free_command(command->next);
-		command->next = NULL;
-	}
-	free(command->name);
+	arena_release(command->arena);
 	free(command);
 	return 0;
 }
 /**
- * Show the command prompt
- * @return [description]
+ * Format the command prompt from $SEASHELL_PROMPT
+ * Slow parts (git) are filled in by a worker thread, see prompt_format
+ * @return the prompt text, valid until the next call
  */
-int show_prompt()
+const char *show_prompt()
 {
-	char cwd[1024], hostname[1024];
-	gethostname(hostname, sizeof(hostname));
-	getcwd(cwd, sizeof(cwd));
-	printf("%s@%s:%s %s$ ", getenv("USER"), hostname, cwd, sysname);
-	return 0;
+	static char prompt[8192];
+	prompt_format(prompt, sizeof(prompt));
+	return prompt;
 }
 /**
  * Parse a command string into a command struct
+ * Single pass over buf, every string and every piped command_t is allocated
+ * from command->arena so free_command releases the whole line in one call.
+ * Handles '' and "" quoted words, backslash escapes, |, &, <, > and >>
+ * with or without spaces around them, and lists of pipelines joined by ;,
+ * && and || with ( ) subshells (see parse_list). buf is not modified.
  * @param  buf     [description]
  * @param  command [description]
  * @return         0
  */
 int parse_command(char *buf, struct command_t *command)
 {
-	const char *splitters = " \t"; // split at whitespace
-	int index, len;
-	len = strlen(buf);
-	while (len > 0 && strchr(splitters, buf[0]) != NULL) // trim left whitespace
-	{
-		buf++;
-		len--;
-	}
-	while (len > 0 && strchr(splitters, buf[len - 1]) != NULL)
-		buf[--len] = 0; // trim right whitespace
+	size_t len = strlen(buf);
+	while (len > 0 && strchr(" \t\r\n", buf[len - 1]) != NULL)
+		len--; // trim right whitespace
 
 	if (len > 0 && buf[len - 1] == '?') // auto-complete
 		command->auto_complete = true;
-	if (len > 0 && buf[len - 1] == '&') // background
-		command->background = true;
-
-	char *pch = strtok(buf, splitters);
-	command->name = (char *)malloc(strlen(pch) + 1);
-	if (pch == NULL)
-		command->name[0] = 0;
-	else
-		strcpy(command->name, pch);
 
-	command->args = (char **)malloc(sizeof(char *));
+	// words never grow when quotes and escapes are removed, each needs one extra terminator
+	struct parse_state st = {.p = buf, .end = buf + len, .arena = &command->arena};
+	st.out = arena_alloc(&command->arena, 2 * len + 2);
+	parse_list(&st, command, 0);
+	return 0;
+}
+/**
+ * Parse a list of pipelines into list
+ * The first stage of every pipeline links to the first stage of the next
+ * one with list_next, list_op tells whether it runs always (; and &), after
+ * a success (&&) or after a failure (||). A ( at the start of a stage parses
+ * a nested list up to the matching ) into the subshell of that stage.
+ * a && b & puts the whole and-or list in the background as a subshell.
+ * @param st    [description]
+ * @param list  first stage of the list, zeroed by the caller
+ * @param depth nesting of subshells, the list ends at ) when it is not 0
+ */
+void parse_list(struct parse_state *st, struct command_t *list, int depth)
+{
+	static char subshell_name[] = "(";
+	struct command_t *current = list;	// stage being parsed
+	struct command_t *pipeline = list;	// its first stage
+	struct command_t *and_or = list;	// first pipeline since the last ; or &
+	int pending_op = -1;				// a new pipeline starts with the next word
+	int args_cap = 0;
+	int pending_redirect = -1;
+	const char *p = st->p, *end = st->end;
 
-	int redirect_index;
-	int arg_index = 0;
-	char temp_buf[1024], *arg;
 	while (1)
 	{
-		// tokenize input on splitters
-		pch = strtok(NULL, splitters);
-		if (!pch)
+		while (p < end && (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n'))
+			p++; // skip whitespace
+		if (p >= end)
 			break;
-		arg = temp_buf;
-		strcpy(arg, pch);
-		len = strlen(arg);
 
-		if (len == 0)
-			continue;										 // empty arg, go for next
-		while (len > 0 && strchr(splitters, arg[0]) != NULL) // trim left whitespace
+		if (*p == ')')
+		{
+			p++;
+			if (depth > 0)
+				break;
+			continue; // unmatched, ignored
+		}
+		// ; && || end the pipeline
+		if (*p == ';' || (*p == '&' && p + 1 < end && p[1] == '&') || (*p == '|' && p + 1 < end && p[1] == '|'))
+		{
+			parse_finish_stage(current, st->out++);
+			pending_op = *p == ';' ? LIST_SEQ : *p == '&' ? LIST_AND : LIST_OR;
+			if (*p == ';')
+				and_or = NULL;
+			p += *p == ';' ? 1 : 2;
+			continue;
+		}
+		// background process, also ends the pipeline
+		if (*p == '&')
+		{
+			parse_finish_stage(current, st->out++);
+			if (and_or && and_or != pipeline)
+			{
+				// a && b &: the and-or list moves into a subshell stage in its place
+				struct command_t *inner = arena_alloc(st->arena, sizeof(struct command_t));
+				*inner = *and_or;
+				inner->arena = NULL;
+				bool auto_complete = and_or->auto_complete;
+				struct arena *arena = and_or->arena;
+				memset(and_or, 0, sizeof(struct command_t));
+				and_or->arena = arena;
+				and_or->auto_complete = auto_complete;
+				and_or->subshell = inner;
+				and_or->name = subshell_name;
+				parse_finish_stage(and_or, st->out++);
+				current = pipeline = and_or;
+			}
+			pipeline->background = true;
+			current->background = true;
+			pending_op = LIST_SEQ;
+			and_or = NULL;
+			p++;
+			continue;
+		}
+
+		// the first word or ( after a separator starts the next pipeline
+		if (pending_op != -1)
 		{
-			arg++;
-			len--;
+			struct command_t *next = arena_alloc(st->arena, sizeof(struct command_t));
+			memset(next, 0, sizeof(struct command_t));
+			pipeline->list_next = next;
+			pipeline->list_op = pending_op;
+			current = pipeline = next;
+			if (and_or == NULL)
+				and_or = next;
+			pending_op = -1;
+			args_cap = 0;
 		}
-		while (len > 0 && strchr(splitters, arg[len - 1]) != NULL)
-			arg[--len] = 0; // trim right whitespace
-		if (len == 0)
-			continue; // empty arg, go for next
 
 		// piping to another command
-		if (strcmp(arg, "|") == 0)
+		if (*p == '|')
 		{
-			struct command_t *c = malloc(sizeof(struct command_t));
-			int l = strlen(pch);
-			pch[l] = splitters[0]; // restore strtok termination
-			index = 1;
-			while (pch[index] == ' ' || pch[index] == '\t')
-				index++; // skip whitespaces
-
-			parse_command(pch + index, c);
-			pch[l] = 0; // put back strtok termination
-			command->next = c;
+			parse_finish_stage(current, st->out++);
+			current->next = arena_alloc(st->arena, sizeof(struct command_t));
+			memset(current->next, 0, sizeof(struct command_t));
+			current = current->next;
+			args_cap = 0;
+			p++;
+			continue;
+		}
+		// input and output redirection, the file name is the next word
+		if (*p == '<' || *p == '>')
+		{
+			if (*p == '<')
+				pending_redirect = 0;
+			else if (p + 1 < end && p[1] == '>')
+				pending_redirect = 2, p++;
+			else
+				pending_redirect = 1;
+			p++;
+			continue;
+		}
+		// subshell, only at the start of a stage
+		if (*p == '(')
+		{
+			if (current->name != NULL || current->subshell != NULL)
+			{
+				p++; // ignored like an unmatched )
+				continue;
+			}
+			current->subshell = arena_alloc(st->arena, sizeof(struct command_t));
+			memset(current->subshell, 0, sizeof(struct command_t));
+			st->p = p + 1;
+			parse_list(st, current->subshell, depth + 1);
+			p = st->p;
+			current->name = subshell_name;
 			continue;
 		}
 
-		// background process
-		if (strcmp(arg, "&") == 0)
-			continue; // handled before
-
-		// handle input redirection
-		redirect_index = -1;
-		if (arg[0] == '<')
-			redirect_index = 0;
-		if (arg[0] == '>')
+		// a word, quoted parts and escapes are joined into one argument
+		char *word = st->out, *out = st->out;
+		while (p < end && !strchr(" \t\r\n|&<>;()", *p))
 		{
-			if (len > 1 && arg[1] == '>')
+			if (*p == '\'')
 			{
-				redirect_index = 2;
-				arg++;
-				len--;
+				for (p++; p < end && *p != '\''; )
+					*out++ = *p++;
+				p++;
+			}
+			else if (*p == '"')
+			{
+				for (p++; p < end && *p != '"'; )
+				{
+					if (*p == '\\' && p + 1 < end && strchr("\"\\$`", p[1]))
+						p++;
+					*out++ = *p++;
+				}
+				p++;
+			}
+			else if (*p == '\\' && p + 1 < end)
+			{
+				*out++ = p[1];
+				p += 2;
 			}
 			else
-				redirect_index = 1;
+				*out++ = *p++;
 		}
-		if (redirect_index != -1)
+		*out++ = 0;
+		st->out = out;
+		if (p > end)
+			p = end; // unterminated quote
+
+		if (pending_redirect != -1)
 		{
-			command->redirects[redirect_index] = malloc(len);
-			strcpy(command->redirects[redirect_index], arg + 1);
-			continue;
+			current->redirects[pending_redirect] = word;
+			pending_redirect = -1;
 		}
-
-		// normal arguments
-		if (len > 2 && ((arg[0] == '"' && arg[len - 1] == '"') || (arg[0] == '\'' && arg[len - 1] == '\''))) // quote wrapped arg
+		else if (current->name == NULL)
+			current->name = word;
+		else
 		{
-			arg[--len] = 0;
-			arg++;
+			// the argument array doubles inside the arena, old arrays are dropped with it
+			if (current->arg_count + 1 >= args_cap)
+			{
+				int new_cap = args_cap ? args_cap * 2 : 8;
+				char **args = arena_alloc(st->arena, sizeof(char *) * new_cap);
+				if (current->arg_count)
+					memcpy(args, current->args, sizeof(char *) * current->arg_count);
+				current->args = args;
+				args_cap = new_cap;
+			}
+			current->args[current->arg_count++] = word;
 		}
-		command->args = (char **)realloc(command->args, sizeof(char *) * (arg_index + 1));
-		command->args[arg_index] = (char *)malloc(len + 1);
-		strcpy(command->args[arg_index++], arg);
 	}
-	command->arg_count = arg_index;
-	return 0;
+	parse_finish_stage(current, st->out++);
+	st->p = p;
 }
-void prompt_backspace()
+/**
+ * Give a parsed stage an empty name and a NULL terminated argument list
+ * @param command [description]
+ * @param empty   spare byte in the arena used for an empty name
+ */
+void parse_finish_stage(struct command_t *command, char *empty)
 {
-	putchar(8);	  // go back 1
-	putchar(' '); // write empty over
-	putchar(8);	  // go back 1 again
+	if (command->name == NULL)
+	{
+		*empty = 0;
+		command->name = empty;
+	}
+	if (command->args == NULL)
+	{
+		static char *no_args[] = {NULL};
+		command->args = no_args;
+	}
+	else
+		command->args[command->arg_count] = NULL;
 }
 /**
  * Prompt a command from the user
- * @param  buf      [description]
- * @param  buf_size [description]
- * @return          [description]
+ * The line is read by the line editor (line_edit) with the terminal in
+ * non-canonical mode, the settings are restored before returning.
+ * @param  command [description]
+ * @return         EXIT on Ctrl-D at an empty line, SUCCESS otherwise
  */
 int prompt(struct command_t *command)
 {
-	int index = 0;
-	char c;
-	char buf[4096];
-	static char oldbuf[4096];
-
 	// tcgetattr gets the parameters of the current terminal
 	// STDIN_FILENO will tell tcgetattr that it should write the settings
 	// of stdin to oldt
@@ -253,89 +559,31 @@ int prompt(struct command_t *command)
 	new_termios = backup_termios;
 	// ICANON normally takes care that one line at a time will be processed
 	// that means it will return if it sees a "\n" or an EOF or an EOL
-	new_termios.c_lflag &= ~(ICANON | ECHO); // Also disable automatic echo. We manually echo each char.
+	// ECHO is done by the line editor, ^C and ^V reach it as keys instead of signals
+	new_termios.c_lflag &= ~(ICANON | ECHO | ISIG | IEXTEN);
+	new_termios.c_cc[VMIN] = 1;
+	new_termios.c_cc[VTIME] = 0;
 	// Those new settings will be set to STDIN
 	// TCSANOW tells tcsetattr to change attributes immediately.
 	tcsetattr(STDIN_FILENO, TCSANOW, &new_termios);
 
-	//FIXME: backspace is applied before printing chars
-	show_prompt();
-	int multicode_state = 0;
-	buf[0] = 0;
-	while (1)
-	{
-		c = getchar();
-		//  printf("Keycode: %u\n", c); // DEBUG: uncomment for debugging
-
-		if (c == 9) // handle tab
-		{
-			buf[index++] = '?'; // autocomplete
-			break;
-		}
-
-		if (c == 127) // handle backspace
-		{
-			if (index > 0)
-			{
-				prompt_backspace();
-				index--;
-			}
-			continue;
-		}
-		if (c == 27 && multicode_state == 0) // handle multi-code keys
-		{
-			multicode_state = 1;
-			continue;
-		}
-		if (c == 91 && multicode_state == 1)
-		{
-			multicode_state = 2;
-			continue;
-		}
-		if (c == 65 && multicode_state == 2) // up arrow
-		{
-			int i;
-			while (index > 0)
-			{
-				prompt_backspace();
-				index--;
-			}
-			for (i = 0; oldbuf[i]; ++i)
-			{
-				putchar(oldbuf[i]);
-				buf[i] = oldbuf[i];
-			}
-			index = i;
-			continue;
-		}
-		else
-			multicode_state = 0;
-
-		putchar(c); // echo the character
-		buf[index++] = c;
-		if (index >= sizeof(buf) - 1)
-			break;
-		if (c == '\n') // enter key
-			break;
-		if (c == 4) // Ctrl+D
-			return EXIT;
-	}
-	if (index > 0 && buf[index - 1] == '\n') // trim newline from the end
-		index--;
-	buf[index++] = 0; // null terminate string
+	prompt_request_git();
+	char *buf = line_edit(show_prompt());
 
-	strcpy(oldbuf, buf);
+	// restore the old settings
+	tcsetattr(STDIN_FILENO, TCSANOW, &backup_termios);
+	if (buf == NULL)
+		return EXIT;
 
+	history_add(buf);
 	parse_command(buf, command);
+	free(buf);
 
 	// print_command(command); // DEBUG: uncomment for debugging
-
-	// restore the old settings
-	tcsetattr(STDIN_FILENO, TCSANOW, &backup_termios);
 	return SUCCESS;
 }
 int process_command(struct command_t *command);
-int main()
+int main(int argc, char *argv[])
 {
 
 	//
@@ -348,12 +596,39 @@ int main()
 	strcpy(pathfile_path, abspath);
 	strcat(namefile_path, "name.txt");
 	strcat(pathfile_path, "path.txt");
+	strcpy(shortdir_db_path, abspath);
+	strcat(shortdir_db_path, "shortdir.db");
+	strcpy(kdiff_cache_path, abspath);
+	strcat(kdiff_cache_path, "kdiff.cache");
+	if (getenv("HOME"))
+		snprintf(history_path, sizeof(history_path), "%s/.seashell_history", getenv("HOME"));
 	//
 	//
 	//
+	job_control_init();
+	if (getenv("SEASHELL_HELPERS"))
+		helper_pool_resize(atoi(getenv("SEASHELL_HELPERS")));
+
+	// seashell -c "commands", seashell script.sh and piped stdin skip the prompt and termios
+	if (argc > 2 && strcmp(argv[1], "-c") == 0)
+		return run_batch_buffer(argv[2], strlen(argv[2]));
+	if (argc > 1)
+	{
+		int fd = open(argv[1], O_RDONLY | O_CLOEXEC);
+		if (fd == -1)
+		{
+			fprintf(stderr, "%s: %s: %s\n", sysname, argv[1], strerror(errno));
+			return 127;
+		}
+		return run_batch(fd);
+	}
+	if (!isatty(STDIN_FILENO))
+		return run_batch(STDIN_FILENO);
 
 	while (1)
 	{
+		notify_jobs();
+
 		struct command_t *command = malloc(sizeof(struct command_t));
 		memset(command, 0, sizeof(struct command_t)); // set all bytes to 0
 
@@ -375,33 +650,123 @@ int main()
 
 int process_command(struct command_t *command)
 {
-	int r;
+	// a ; b runs both, a && b runs b after a succeeded and a || b after it failed
+	// a skipped pipeline passes its operator on, so false && a || b runs b
+	struct command_t *pipeline = command;
+	while (pipeline)
+	{
+		if (process_pipeline(pipeline) == EXIT)
+			return EXIT;
+		int op = pipeline->list_op;
+		pipeline = pipeline->list_next;
+		while (pipeline && ((op == LIST_AND && last_status != 0) || (op == LIST_OR && last_status == 0)))
+		{
+			op = pipeline->list_op;
+			pipeline = pipeline->list_next;
+		}
+	}
+	return SUCCESS;
+}
+
+/**
+ * Run one pipeline of a command line
+ * @param  command first stage of the pipeline
+ * @return         EXIT for exit, SUCCESS otherwise, the status is in last_status
+ */
+int process_pipeline(struct command_t *command)
+{
 	if (strcmp(command->name, "") == 0)
 		return SUCCESS;
 
 	if (strcmp(command->name, "exit") == 0)
 		return EXIT;
 
+	// time cmd: the rest of the line is run and its record printed when it finishes
+	bool timed = false;
+	if (strcmp(command->name, "time") == 0 && command->arg_count > 0)
+	{
+		command->name = command->args[0];
+		command->args++;
+		command->arg_count--;
+		timed = !command->background;
+	}
+	size_t recorded = stats_count();
+
+	// a lone foreground builtin runs inside the shell so cd/jump affect it
+	int r;
+	if (command->next == NULL && !command->background && is_builtin(command->name))
+	{
+		int redirect_fds[2];
+		if (open_redirects(command, redirect_fds) == -1)
+		{
+			last_status = 1;
+			return SUCCESS;
+		}
+		last_status = 0; // builtins only set it when they fail
+		r = stats_run_builtin(command, redirect_fds);
+	}
+	else
+		r = run_pipeline(command);
+	if (timed)
+		stats_print_time(recorded);
+	return r;
+}
+
+/**
+ * Check whether a command name is handled by run_builtin
+ * @param  name [description]
+ * @return      [description]
+ */
+const char *builtin_names[] = {"cd", "shortdir", "highlight", "goodMorning", "kdiff", "concatenate", "hash", "spawnbench",
+	"jobs", "fg", "bg", "wait", "parsebench", "stats", "bench", "parallel", "helpers", NULL};
+bool is_builtin(const char *name)
+{
+	for (int i = 0; builtin_names[i]; i++)
+		if (strcmp(name, builtin_names[i]) == 0)
+			return true;
+	return false;
+}
+/**
+ * Run a builtin command in the current process
+ * @param  command [description]
+ * @return         NOT_BUILTIN if the name is not a builtin
+ */
+int run_builtin(struct command_t *command)
+{
+	int r;
 	if (strcmp(command->name, "cd") == 0)
 	{
 		if (command->arg_count > 0)
 		{
 			r = chdir(command->args[0]);
 			if (r == -1)
+			{
 				printf("-%s: %s: %s\n", sysname, command->name, strerror(errno));
-			return SUCCESS;
+				last_status = 1;
+			}
+			else
+			{
+				prompt_cwd_changed();
+				shortdir_record_visit();
+			}
 		}
+		return SUCCESS;
 	}
 	//---------------QUESTION 2---------------//
 	else if (strcmp(command->name, "shortdir") == 0)
 	{
-		if(strcmp(command->args[0], "set") == 0 && command->args[1]!= NULL){
+		if(command->arg_count == 0){
+			printf("Wrong argument\n");
+		}else if(strcmp(command->args[0], "set") == 0 && command->args[1]!= NULL){
 			char cwd[500];
 			set_name(command->args[1],getcwd(cwd, sizeof(cwd)));
 		}else if(strcmp(command->args[0], "jump") == 0 && command->args[1]!= NULL){
-			char *path = get_path(command->args[1]);
-			if(strcmp(path, " ")!= 0){
-				chdir(path);
+			const char *path = shortdir_find(command->args[1]);
+			if(path != NULL && chdir(path) == -1){
+				printf("-%s: %s: %s: %s\n", sysname, command->name, path, strerror(errno));
+			}else if(path != NULL){
+				prompt_cwd_changed();
+				shortdir_record_visit();
 			}
 		}else if(strcmp(command->args[0], "del") == 0 && command->args[1]!= NULL){
 			delete(command->args[1]);
@@ -418,10 +783,10 @@ int process_command(struct command_t *command)
 	
 	//---------------QUESTION 3---------------//
 	else if(strcmp(command->name, "highlight") == 0){
-		if(command->arg_count == 3){
+		if(command->arg_count == 3 && command->args[0][0] != '-'){
 			highlight(command->args[0], command->args[1], command->args[2]);
 		}else{
-			printf("Error with the argument format\n");
+			highlight_command(command->arg_count, command->args);
 		}
 		return SUCCESS;
 	}
@@ -444,7 +809,14 @@ int process_command(struct command_t *command)
 
 		char *crontab_args[] = {"crontab", "new_job.sh", NULL};
 
-		execv("/usr/bin/crontab", crontab_args);
+		const char *crontab_path = resolve_command("crontab");
+		if(crontab_path == NULL){
+			printf("-%s: crontab: command not found\n", sysname);
+			return SUCCESS;
+		}
+		pid_t pid = launch_argv(crontab_path, crontab_args, STDIN_FILENO, STDOUT_FILENO, LAUNCH_SPAWN, -1);
+		if(pid > 0)
+			waitpid(pid, NULL, 0);
 		return SUCCESS;
 	}
 	//---------------QUESTION 5---------------//
@@ -453,9 +825,23 @@ int process_command(struct command_t *command)
 			printf("Problem with the arguments\n");
 		}
 		else if(strcmp(command->args[0], "-b")==0){
-			compare_binary_files(command->args[1], command->args[2]);
+			// kdiff -b [-r] file1 file2
+			bool ranges = command->arg_count == 4 && strcmp(command->args[1], "-r") == 0;
+			if(command->arg_count == 3 || ranges)
+				compare_binary_files(command->args[command->arg_count-2], command->args[command->arg_count-1], ranges);
+			else
+				printf("Problem with the arguments\n");
 		}else{
-			compare_txt_files(command->args[command->arg_count-2], command->args[command->arg_count-1]);
+			// kdiff [-a] [--histogram] [-U n] file1.txt file2.txt
+			int algorithm = DIFF_MYERS;
+			int context = 3;
+			for(int i = 0; i < command->arg_count - 2; i++){
+				if(strcmp(command->args[i], "--histogram") == 0 || strcmp(command->args[i], "-H") == 0)
+					algorithm = DIFF_HISTOGRAM;
+				else if(strcmp(command->args[i], "-U") == 0 && i + 1 < command->arg_count - 2)
+					context = atoi(command->args[++i]);
+			}
+			compare_txt_files(command->args[command->arg_count-2], command->args[command->arg_count-1], algorithm, context);
 		}
 		return SUCCESS;
 	}
@@ -464,425 +850,6884 @@ int process_command(struct command_t *command)
 		concatenate_txt_files(command->arg_count, command->args);
 		return SUCCESS;
 	}
-
-   	pid_t pid = fork();
-	 if (pid == 0) {
-
-		command->args=(char **)realloc(command->args, sizeof(char *)*(command->arg_count+=2));
-
-		for (int i=command->arg_count-2;i>0;--i)
-			command->args[i]=command->args[i-1];
-
-		command->args[0]=strdup(command->name);
-		command->args[command->arg_count-1]=NULL;
-
-	//---------------QUESTION 1---------------//
-		if(command->name[0]=='/' || command->name[0]=='.'){
-			execv(command->name, command->args);
+	else if(strcmp(command->name, "stats") == 0){
+		stats_builtin(command);
+		return SUCCESS;
+	}
+	else if(strcmp(command->name, "hash") == 0){
+		if(command->arg_count == 0){
+			path_hash_list(false);
+		}else if(strcmp(command->args[0], "-r") == 0){
+			path_hash_clear();
+		}else if(strcmp(command->args[0], "-l") == 0){
+			path_hash_list(true);
+		}else if(strcmp(command->args[0], "-p") == 0){
+			if(command->arg_count != 3)
+				printf("-%s: hash: usage: hash -p path name\n", sysname);
+			else
+				path_hash_set(command->args[1], command->args[2]);
+		}else{
+			for(int i = 0; i < command->arg_count; i++)
+				if(resolve_command(command->args[i]) == NULL)
+					printf("-%s: hash: %s: not found\n", sysname, command->args[i]);
 		}
-		else if(strcmp(command->name, "gcc")==0){
-			execv("/usr/bin/gcc", command->args);
+		return SUCCESS;
+	}
+	else if(strcmp(command->name, "jobs") == 0 || strcmp(command->name, "fg") == 0 ||
+		strcmp(command->name, "bg") == 0 || strcmp(command->name, "wait") == 0){
+		return job_builtin(command);
+	}
+	else if(strcmp(command->name, "helpers") == 0){
+		helper_builtin(command);
+		return SUCCESS;
+	}
+	else if(strcmp(command->name, "parallel") == 0){
+		return parallel_builtin(command);
+	}
+	else if(strcmp(command->name, "parsebench") == 0){
+		// parsebench [megabytes], 64 MB of generated command lines by default
+		parse_benchmark(command->arg_count > 0 && atoi(command->args[0]) > 0 ? atoi(command->args[0]) : 64);
+		return SUCCESS;
+	}
+	else if(strcmp(command->name, "bench") == 0){
+		// bench [-b baseline] [-u] [-p percent] [-t tests] [size...], see bench_builtin
+		bench_builtin(command);
+		return SUCCESS;
+	}
+	else if(strcmp(command->name, "spawnbench") == 0){
+		// spawnbench [count] [command args...], /bin/true 1000 times by default
+		int count = 1000;
+		int first = 0;
+		if(command->arg_count > 0 && atoi(command->args[0]) > 0){
+			count = atoi(command->args[0]);
+			first = 1;
 		}
-
-		else{
-			char path[100] = "/bin/";
-			strcat(path, command->name);
-			execv(path, command->args);
+		char *default_argv[] = {"true", NULL};
+		char **argv = default_argv;
+		if(command->arg_count > first){
+			argv = malloc(sizeof(char *) * (command->arg_count - first + 1));
+			for(int i = first; i < command->arg_count; i++)
+				argv[i - first] = command->args[i];
+			argv[command->arg_count - first] = NULL;
 		}
-     }
-
-	
-	else
-	{
-		if (!command->background)
-			wait(0); // wait for child process to finish
+		spawn_benchmark(count, argv);
+		if(argv != default_argv)
+			free(argv);
 		return SUCCESS;
 	}
-
-	printf("-%s: %s: command not found\n", sysname, command->name);
-	return UNKNOWN;
+	return NOT_BUILTIN;
 }
 
 // HELPER METHODS FOR QUESTIONS 2-3-5-6 //
 
 // QUESTION 2 HELPER METHODS START //
 
-//find the line number of the name or path from the txt files
-//if there is no association returns -1
-//related updates are done according to line number
-int find_index(char* str1, char* file_name){
-   int line_num=0;
-   int is_found = -1;
+//the associations live in memory in two hash tables, by name and by path,
+//and are persisted in shortdir.db as an append-only journal of records:
+//  S<TAB>name<TAB>path   set an association
+//  D<TAB>name            delete an association
+//  C                     delete every association
+//  V<TAB>time<TAB>path   a cd or jump into path
+//  R<TAB>rank<TAB>time<TAB>path  accumulated visits of a directory
+//  A                     every rank was aged, see shortdir_visits_age
+//the journal is compacted into one S record per alias and one R record per
+//directory with an atomic rename once it holds more than twice as many records as that
+struct shortdir_entry
+{
+	char *name;
+	char *path;
+	struct shortdir_entry *name_next;
+	struct shortdir_entry *path_next;
+};
 
-   char line[256];
-   char name[256];
-   strcpy(name, str1);
+//visited directories are ranked by frecency like z/autojump
+struct shortdir_visit
+{
+	char *path;
+	double rank;
+	time_t last;
+	struct shortdir_visit *next;
+};
 
-   FILE* file = fopen(file_name, "r"); 
+//sorted index of lowercase alias names and directory basenames for prefix lookups
+struct shortdir_key
+{
+	char *key;
+	const char *path;
+};
 
-   if(file==NULL){
-      return -1;
-   }
+struct shortdir_store
+{
+	struct shortdir_entry **by_name;
+	struct shortdir_entry **by_path;
+	size_t bucket_count;
+	size_t count;
+	size_t records;		// records in the journal
+	bool loaded;
+	struct shortdir_visit **visits;
+	size_t visit_bucket_count;
+	size_t visit_count;
+	double total_rank;
+	struct shortdir_key *index;
+	size_t index_count;
+	bool index_dirty;
+	// the journal as of the last read or write, other sessions may append to it
+	dev_t dev;
+	ino_t ino;
+	off_t size;
+} shortdir;
 
-   while (fgets(line, sizeof(line), file)) {
-      if(strcmp(line, name) == 0){
-         is_found ++;
-         break;
-      }
-      line_num ++;   
-   }
-   fclose(file);
-   return is_found==-1 ? -1 : line_num;
+struct shortdir_entry **shortdir_name_link(const char *name){
+	struct shortdir_entry **link = &shortdir.by_name[hash_string(name) % shortdir.bucket_count];
+	while (*link && strcmp((*link)->name, name) != 0)
+		link = &(*link)->name_next;
+	return link;
 }
 
-//deletes all associations by removing txt files
-void clear(){
-   remove(namefile_path);
-   remove(pathfile_path);
-   printf("All associations are removed\n");
+struct shortdir_entry **shortdir_path_link(const char *path){
+	struct shortdir_entry **link = &shortdir.by_path[hash_string(path) % shortdir.bucket_count];
+	while (*link && strcmp((*link)->path, path) != 0)
+		link = &(*link)->path_next;
+	return link;
 }
 
-//updates the value in the given line of the file
-void update_txt(int line_number, char *new_txt, char *file_name){
-	if (line_number<0){
-		return;
-	}
-      FILE *txt_file, *dummy;
-      txt_file = fopen(file_name, "r");
-      dummy = fopen("dummy.txt", "a+"); 
-      char line[100];
-      int count = 0;
+//unlinks an entry from both tables and frees it
+void shortdir_unlink(struct shortdir_entry *e){
+	shortdir.index_dirty = true;
+	*shortdir_name_link(e->name) = e->name_next;
+	*shortdir_path_link(e->path) = e->path_next;
+	free(e->name);
+	free(e->path);
+	free(e);
+	shortdir.count--;
+}
+
+void shortdir_apply_clear(){
+	for (size_t i = 0; i < shortdir.bucket_count; i++)
+		while (shortdir.by_name[i])
+			shortdir_unlink(shortdir.by_name[i]);
+}
 
-      while (fgets(line, sizeof(line), txt_file) != NULL){
-         if (count == line_number){
-            fputs(new_txt, dummy);
-         }else{
-            fputs(line, dummy);
-         }
-         count++;
-      }
-      fclose(txt_file);
-      fclose(dummy);
+//the tables double when the load factor passes 1
+void shortdir_grow(){
+	size_t old_count = shortdir.bucket_count;
+	struct shortdir_entry **old = shortdir.by_name;
 
-      remove(file_name);
-      rename("dummy.txt", file_name);
+	shortdir.bucket_count = old_count ? old_count * 2 : 64;
+	shortdir.by_name = calloc(shortdir.bucket_count, sizeof(struct shortdir_entry *));
+	free(shortdir.by_path);
+	shortdir.by_path = calloc(shortdir.bucket_count, sizeof(struct shortdir_entry *));
+	for (size_t i = 0; i < old_count; i++)
+	{
+		struct shortdir_entry *e = old[i];
+		while (e)
+		{
+			struct shortdir_entry *next = e->name_next;
+			struct shortdir_entry **name_bucket = &shortdir.by_name[hash_string(e->name) % shortdir.bucket_count];
+			struct shortdir_entry **path_bucket = &shortdir.by_path[hash_string(e->path) % shortdir.bucket_count];
+			e->name_next = *name_bucket;
+			*name_bucket = e;
+			e->path_next = *path_bucket;
+			*path_bucket = e;
+			e = next;
+		}
+	}
+	free(old);
 }
 
-//set or update the association in txt files
-void set_name(char *name, char *path){
-   char inp_name[100], inp_path[100];
-   
-   strcpy(inp_name, name);
-   strcat(inp_name, "\n");
-   strcpy(inp_path, path);
-   strcat(inp_path, "\n");
-
-   int index_path = find_index(inp_path, pathfile_path);
-   int index_name = find_index(inp_name, namefile_path);
-
-   if(index_name>index_path){
-	   update_txt(index_name, "", namefile_path);
-	   update_txt(index_name, "", pathfile_path);
-	   update_txt(index_path, "", namefile_path);
-	   update_txt(index_path, "", pathfile_path);
-   }else{
-	   update_txt(index_path, "", namefile_path);
-	   update_txt(index_path, "", pathfile_path);
-	   update_txt(index_name, "", namefile_path);
-	   update_txt(index_name, "", pathfile_path);
-   }
+//a directory has at most one alias, setting a name replaces the old alias of the path too
+void shortdir_apply_set(const char *name, const char *path){
+	struct shortdir_entry *e;
+	if (shortdir.count + 1 > shortdir.bucket_count)
+		shortdir_grow();
+	if ((e = *shortdir_name_link(name)))
+		shortdir_unlink(e);
+	if ((e = *shortdir_path_link(path)))
+		shortdir_unlink(e);
 
-	FILE *fp_name, *fp_path;
-	fp_name = fopen(namefile_path, "a+");
-	fp_path = fopen(pathfile_path, "a+");
-	fputs(inp_name, fp_name);
-	fputs(inp_path, fp_path);
-	fclose(fp_name);
-	fclose(fp_path);
+	shortdir.index_dirty = true;
+	e = malloc(sizeof(struct shortdir_entry));
+	e->name = strdup(name);
+	e->path = strdup(path);
+	struct shortdir_entry **name_bucket = &shortdir.by_name[hash_string(name) % shortdir.bucket_count];
+	struct shortdir_entry **path_bucket = &shortdir.by_path[hash_string(path) % shortdir.bucket_count];
+	e->name_next = *name_bucket;
+	*name_bucket = e;
+	e->path_next = *path_bucket;
+	*path_bucket = e;
+	shortdir.count++;
+}
 
-   printf("%s is set as an alias for %s\n", name, path);
+struct shortdir_visit **shortdir_visit_link(const char *path){
+	struct shortdir_visit **link = &shortdir.visits[hash_string(path) % shortdir.visit_bucket_count];
+	while (*link && strcmp((*link)->path, path) != 0)
+		link = &(*link)->next;
+	return link;
 }
 
-//deletes the association from the txt files
-void delete(char *name){
-   char inp_name[100];
-   
-   strcpy(inp_name, name);
-   strcat(inp_name, "\n");
-
-   int index = find_index(inp_name, namefile_path);
-   if(index!=-1){
-      update_txt(index, "", namefile_path);
-      update_txt(index, "", pathfile_path);
-	  printf("%s association is removed\n", name);
-   }else{
-      printf("No association with the given name %s\n", name);
-   }
+//forgets every visited directory, used before the journal is reloaded
+void shortdir_visits_clear(){
+	for (size_t i = 0; i < shortdir.visit_bucket_count; i++)
+	{
+		while (shortdir.visits[i])
+		{
+			struct shortdir_visit *v = shortdir.visits[i];
+			shortdir.visits[i] = v->next;
+			free(v->path);
+			free(v);
+		}
+	}
+	shortdir.visit_count = 0;
+	shortdir.total_rank = 0;
+	shortdir.index_dirty = true;
 }
 
-//prints all the present associations
-void list_associations(){
-    FILE *fp_name, *fp_path;
-    fp_name = fopen(namefile_path, "r");
-    fp_path = fopen(pathfile_path, "r");
+//once the ranks add up to more than 100000 every rank is scaled down by 0.9
+//and directories whose rank drops below 1 are forgotten
+//the A record written after the visit lets every session replay the same aging
+void shortdir_visits_age(){
+	shortdir.total_rank = 0;
+	for (size_t i = 0; i < shortdir.visit_bucket_count; i++)
+	{
+		struct shortdir_visit **link = &shortdir.visits[i];
+		while (*link)
+		{
+			struct shortdir_visit *v = *link;
+			v->rank *= 0.9;
+			if (v->rank < 1)
+			{
+				*link = v->next;
+				free(v->path);
+				free(v);
+				shortdir.visit_count--;
+				shortdir.index_dirty = true;
+				continue;
+			}
+			shortdir.total_rank += v->rank;
+			link = &v->next;
+		}
+	}
+}
 
-   if(fp_name==NULL && fp_path==NULL){
-      printf("There isn't any association\n");
-      return;
-   }
+//allocates the empty visit table, it doubles once the load factor passes 1
+void shortdir_visits_init(){
+	shortdir.visit_bucket_count = 256;
+	shortdir.visits = calloc(shortdir.visit_bucket_count, sizeof(struct shortdir_visit *));
+}
 
-   char line_name[100], line_path[100];
-   int counter = 0;
+//adds rank to a directory and updates its last visit time
+void shortdir_apply_visit(const char *path, double rank, time_t when){
+	if (shortdir.visit_count + 1 > shortdir.visit_bucket_count)
+	{
+		size_t old_count = shortdir.visit_bucket_count;
+		struct shortdir_visit **old = shortdir.visits;
+		shortdir.visit_bucket_count = old_count * 2;
+		shortdir.visits = calloc(shortdir.visit_bucket_count, sizeof(struct shortdir_visit *));
+		for (size_t i = 0; i < old_count; i++)
+		{
+			while (old[i])
+			{
+				struct shortdir_visit *v = old[i];
+				old[i] = v->next;
+				struct shortdir_visit **bucket = &shortdir.visits[hash_string(v->path) % shortdir.visit_bucket_count];
+				v->next = *bucket;
+				*bucket = v;
+			}
+		}
+		free(old);
+	}
 
-   while ((fgets(line_name, sizeof(line_name), fp_name) != NULL) && (fgets(line_path, sizeof(line_path), fp_path) != NULL)){
-      printf("\nNAME: %sPATH: %s\n", line_name, line_path);
-	  counter ++;
-   }
-   
-   if (counter==0){
-		printf("There isn't any association\n");
-   }
-   fclose(fp_name);
-   fclose(fp_path);
+	struct shortdir_visit **link = shortdir_visit_link(path);
+	struct shortdir_visit *v = *link;
+	if (v == NULL)
+	{
+		v = calloc(1, sizeof(struct shortdir_visit));
+		v->path = strdup(path);
+		*link = v;
+		shortdir.visit_count++;
+		shortdir.index_dirty = true;
+	}
+	v->rank += rank;
+	if (when > v->last)
+		v->last = when;
+	shortdir.total_rank += rank;
 }
 
-//returns the path corresponding to given name
-//used for shortdir jump
-char* get_path(char *name){
-	char inp_name[100];
-   strcpy(inp_name, name);
-   strcat(inp_name, "\n");
-   int index = find_index(inp_name, namefile_path);
-   char *path = malloc(256);
-
-   if (index==-1){
-      printf("There is no associated path with the given name\n");
-      strcpy(path, "");
-   }else{
-      FILE *fp_path;
-      fp_path = fopen(pathfile_path, "r");
-      
-      char line[100];
-      int count=0;
-
-      while(fgets(line, sizeof(line), fp_path) != NULL){
-         if (count == index){
-            line[strlen(line)-1] = '\0';
-            strcpy(path, line);
-			break;
-         }
-         count ++;
-      }
-      fclose(fp_path);
-   }
-   return path;
+bool shortdir_apply_delete(const char *name){
+	struct shortdir_entry *e = *shortdir_name_link(name);
+	if (e == NULL)
+		return false;
+	shortdir_unlink(e);
+	return true;
 }
-// QUESTION 2 HELPER METHODS END //
-
+
+//applies the journal records in buf, the last line may be incomplete and is ignored
+//returns the number of bytes consumed
+size_t shortdir_replay(char *buf, size_t len){
+	size_t consumed = 0;
+	char *end = buf + len;
+	char *line = buf;
+	char *nl;
+	while ((nl = memchr(line, '\n', end - line)) != NULL)
+	{
+		*nl = 0;
+		char *name = line + 2;
+		if (line[0] == 'C')
+			shortdir_apply_clear();
+		else if (line[0] == 'D' && line[1] == '\t')
+			shortdir_apply_delete(name);
+		else if (line[0] == 'S' && line[1] == '\t')
+		{
+			char *path = strchr(name, '\t');
+			if (path)
+			{
+				*path++ = 0;
+				shortdir_apply_set(name, path);
+			}
+		}
+		else if (line[0] == 'V' && line[1] == '\t')
+		{
+			char *path;
+			time_t when = strtoll(line + 2, &path, 10);
+			if (*path == '\t')
+				shortdir_apply_visit(path + 1, 1, when);
+		}
+		else if (line[0] == 'A')
+			shortdir_visits_age();
+		else if (line[0] == 'R' && line[1] == '\t')
+		{
+			char *time_field, *path;
+			double rank = strtod(line + 2, &time_field);
+			time_t when = strtoll(time_field, &path, 10);
+			if (*path == '\t')
+				shortdir_apply_visit(path + 1, rank, when);
+		}
+		shortdir.records++;
+		line = nl + 1;
+		consumed = line - buf;
+	}
+	return consumed;
+}
+
+//reads the journal from offset to its end and replays it
+void shortdir_read_from(int fd, off_t offset, off_t size){
+	if (size <= offset)
+		return;
+	size_t len = size - offset;
+	char *buf = malloc(len);
+	ssize_t n = pread(fd, buf, len, offset);
+	if (n > 0)
+		shortdir.size = offset + shortdir_replay(buf, n);
+	free(buf);
+}
+
+//imports the associations kept in name.txt and path.txt by older versions
+void shortdir_import_txt(){
+	FILE *fp_name = fopen(namefile_path, "r");
+	FILE *fp_path = fopen(pathfile_path, "r");
+	if (fp_name && fp_path)
+	{
+		char *line_name = NULL, *line_path = NULL;
+		size_t cap_name = 0, cap_path = 0;
+		ssize_t l1, l2;
+		while ((l1 = getline(&line_name, &cap_name, fp_name)) > 0 && (l2 = getline(&line_path, &cap_path, fp_path)) > 0)
+		{
+			if (line_name[l1 - 1] == '\n')
+				line_name[--l1] = 0;
+			if (line_path[l2 - 1] == '\n')
+				line_path[--l2] = 0;
+			if (l1 > 0 && l2 > 0)
+				shortdir_apply_set(line_name, line_path);
+		}
+		free(line_name);
+		free(line_path);
+	}
+	if (fp_name)
+		fclose(fp_name);
+	if (fp_path)
+		fclose(fp_path);
+}
+
+//brings the in-memory tables up to date with the journal
+//only the records appended by other sessions since the last call are read
+void shortdir_refresh(){
+	struct stat st;
+	if (shortdir.bucket_count == 0)
+	{
+		shortdir_grow();
+		shortdir_visits_init();
+	}
+
+	if (stat(shortdir_db_path, &st) == -1)
+	{
+		shortdir.ino = 0;
+		shortdir.size = 0;
+		if (shortdir.loaded)
+		{
+			shortdir_apply_clear(); // removed behind our back
+			shortdir_visits_clear();
+		}
+		else
+		{
+			shortdir_import_txt();
+			if (shortdir.count > 0 && (shortdir_compact(), shortdir.ino != 0))
+			{
+				remove(namefile_path);
+				remove(pathfile_path);
+			}
+		}
+		shortdir.loaded = true;
+		return;
+	}
+	if (shortdir.loaded && st.st_dev == shortdir.dev && st.st_ino == shortdir.ino && st.st_size == shortdir.size)
+		return;
+
+	int fd = open(shortdir_db_path, O_RDONLY | O_CLOEXEC);
+	if (fd == -1)
+		return;
+	if (!shortdir.loaded || st.st_dev != shortdir.dev || st.st_ino != shortdir.ino || st.st_size < shortdir.size)
+	{
+		// first load, or the journal was compacted by another session
+		shortdir_apply_clear();
+		shortdir_visits_clear();
+		shortdir.records = 0;
+		shortdir.size = 0;
+	}
+	shortdir.loaded = true;
+	shortdir.dev = st.st_dev;
+	shortdir.ino = st.st_ino;
+	shortdir_read_from(fd, shortdir.size, st.st_size);
+	close(fd);
+}
+
+//opens the journal for appending and locks it against other sessions
+//returns -1 if the journal can not be opened, the error is only printed when report is set
+int shortdir_lock(bool report){
+	shortdir_refresh(); // imports name.txt/path.txt before the journal is created
+	while (1)
+	{
+		int fd = open(shortdir_db_path, O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0644);
+		if (fd == -1)
+		{
+			if (report)
+				printf("-%s: %s: %s\n", sysname, shortdir_db_path, strerror(errno));
+			return -1;
+		}
+		flock(fd, LOCK_EX);
+		// a compaction may have replaced the file while we were waiting for the lock
+		struct stat fd_st, path_st;
+		fstat(fd, &fd_st);
+		if (stat(shortdir_db_path, &path_st) == 0 && fd_st.st_ino == path_st.st_ino && fd_st.st_dev == path_st.st_dev)
+		{
+			shortdir_refresh();
+			return fd;
+		}
+		close(fd);
+	}
+}
+
+//writes every alias into a new journal and renames it over the old one
+void shortdir_compact(){
+	char tmp_path[520];
+	snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", shortdir_db_path);
+	FILE *tmp = fopen(tmp_path, "we");
+	if (tmp == NULL)
+		return;
+	size_t records = 0;
+	for (size_t i = 0; i < shortdir.bucket_count; i++)
+		for (struct shortdir_entry *e = shortdir.by_name[i]; e; e = e->name_next, records++)
+			fprintf(tmp, "S\t%s\t%s\n", e->name, e->path);
+	for (size_t i = 0; i < shortdir.visit_bucket_count; i++)
+		for (struct shortdir_visit *v = shortdir.visits[i]; v; v = v->next, records++)
+			fprintf(tmp, "R\t%.3f\t%lld\t%s\n", v->rank, (long long)v->last, v->path);
+	fflush(tmp);
+	fsync(fileno(tmp));
+	struct stat st;
+	fstat(fileno(tmp), &st);
+	fclose(tmp);
+
+	if (rename(tmp_path, shortdir_db_path) == 0)
+	{
+		shortdir.dev = st.st_dev;
+		shortdir.ino = st.st_ino;
+		shortdir.size = st.st_size;
+		shortdir.records = records;
+	}
+}
+
+//appends one record with a single write and unlocks the journal
+void shortdir_append(int fd, const char *record){
+	size_t len = strlen(record);
+	if (write(fd, record, len) == (ssize_t)len)
+	{
+		struct stat st;
+		fstat(fd, &st);
+		shortdir.dev = st.st_dev;
+		shortdir.ino = st.st_ino;
+		shortdir.size = st.st_size;
+		shortdir.records++;
+	}
+	if (shortdir.records > 2 * (shortdir.count + shortdir.visit_count) + 64)
+		shortdir_compact();
+	flock(fd, LOCK_UN);
+	close(fd);
+}
+
+//deletes all associations
+void clear(){
+	int fd = shortdir_lock(true);
+	if (fd == -1)
+		return;
+	shortdir_apply_clear();
+	shortdir_append(fd, "C\n");
+	remove(namefile_path);
+	remove(pathfile_path);
+	printf("All associations are removed\n");
+}
+
+//set or update the association
+void set_name(char *name, char *path){
+	if (strchr(name, '\t') || strchr(name, '\n') || strchr(path, '\n'))
+	{
+		printf("Alias names can not contain tabs or newlines\n");
+		return;
+	}
+	int fd = shortdir_lock(true);
+	if (fd == -1)
+		return;
+	shortdir_apply_set(name, path);
+	char *record = malloc(strlen(name) + strlen(path) + 5);
+	sprintf(record, "S\t%s\t%s\n", name, path);
+	shortdir_append(fd, record);
+	free(record);
+	printf("%s is set as an alias for %s\n", name, path);
+}
+
+//deletes the association
+void delete(char *name){
+	shortdir_refresh();
+	if (*shortdir_name_link(name) == NULL)
+	{
+		printf("No association with the given name %s\n", name);
+		return;
+	}
+	int fd = shortdir_lock(true);
+	if (fd == -1)
+		return;
+	shortdir_apply_delete(name);
+	char *record = malloc(strlen(name) + 4);
+	sprintf(record, "D\t%s\n", name);
+	shortdir_append(fd, record);
+	free(record);
+	printf("%s association is removed\n", name);
+}
+
+int shortdir_entry_compare(const void *a, const void *b){
+	return strcmp((*(struct shortdir_entry **)a)->name, (*(struct shortdir_entry **)b)->name);
+}
+
+//prints all the present associations sorted by name
+void list_associations(){
+	shortdir_refresh();
+	if (shortdir.count == 0)
+	{
+		printf("There isn't any association\n");
+		return;
+	}
+	struct shortdir_entry **entries = malloc(sizeof(struct shortdir_entry *) * shortdir.count);
+	size_t n = 0;
+	for (size_t i = 0; i < shortdir.bucket_count; i++)
+		for (struct shortdir_entry *e = shortdir.by_name[i]; e; e = e->name_next)
+			entries[n++] = e;
+	qsort(entries, n, sizeof(struct shortdir_entry *), shortdir_entry_compare);
+	for (size_t i = 0; i < n; i++)
+		printf("\nNAME: %s\nPATH: %s\n\n", entries[i]->name, entries[i]->path);
+	free(entries);
+}
+
+//returns the path corresponding to given name, NULL if there is none
+//used for shortdir jump
+const char* get_path(char *name){
+	shortdir_refresh();
+	struct shortdir_entry *e = *shortdir_name_link(name);
+	if (e == NULL)
+	{
+		printf("There is no associated path with the given name\n");
+		return NULL;
+	}
+	return e->path;
+}
+//records a cd or jump into the current directory, best effort and silent
+//only interactive shells record visits, scripts would fill the ranks with their own cds
+void shortdir_record_visit(){
+	if (!job_control)
+		return;
+	char cwd[4096];
+	if (getcwd(cwd, sizeof(cwd)) == NULL || strchr(cwd, '\n'))
+		return;
+	int fd = shortdir_lock(false);
+	if (fd == -1)
+		return;
+	time_t now = time(NULL);
+	shortdir_apply_visit(cwd, 1, now);
+	bool age = shortdir.total_rank > 100000;
+	if (age)
+		shortdir_visits_age();
+	char *record = malloc(strlen(cwd) + 32);
+	sprintf(record, "V\t%lld\t%s\n%s", (long long)now, cwd, age ? "A\n" : "");
+	shortdir_append(fd, record);
+	free(record);
+}
+
+//rank weighted by how recently the directory was visited
+double shortdir_frecency(const char *path, time_t now){
+	struct shortdir_visit *v = *shortdir_visit_link(path);
+	if (v == NULL)
+		return 0;
+	time_t age = now - v->last;
+	if (age < 3600)
+		return v->rank * 4;
+	if (age < 86400)
+		return v->rank * 2;
+	if (age < 604800)
+		return v->rank / 2;
+	return v->rank / 4;
+}
+
+int shortdir_key_compare(const void *a, const void *b){
+	return strcmp(((struct shortdir_key *)a)->key, ((struct shortdir_key *)b)->key);
+}
+
+char *shortdir_lower_dup(const char *str){
+	char *lower = strdup(str);
+	for (char *p = lower; *p; p++)
+		if (*p >= 'A' && *p <= 'Z')
+			*p += 32;
+	return lower;
+}
+
+//rebuilds the sorted key index after aliases or directories were added or removed
+void shortdir_build_index(){
+	for (size_t i = 0; i < shortdir.index_count; i++)
+		free(shortdir.index[i].key);
+	free(shortdir.index);
+	shortdir.index = malloc(sizeof(struct shortdir_key) * (shortdir.count + shortdir.visit_count + 1));
+	size_t n = 0;
+	for (size_t i = 0; i < shortdir.bucket_count; i++)
+		for (struct shortdir_entry *e = shortdir.by_name[i]; e; e = e->name_next)
+			shortdir.index[n++] = (struct shortdir_key){shortdir_lower_dup(e->name), e->path};
+	for (size_t i = 0; i < shortdir.visit_bucket_count; i++)
+	{
+		for (struct shortdir_visit *v = shortdir.visits[i]; v; v = v->next)
+		{
+			const char *base = strrchr(v->path, '/');
+			base = base && base[1] ? base + 1 : v->path;
+			shortdir.index[n++] = (struct shortdir_key){shortdir_lower_dup(base), v->path};
+		}
+	}
+	qsort(shortdir.index, n, sizeof(struct shortdir_key), shortdir_key_compare);
+	shortdir.index_count = n;
+	shortdir.index_dirty = false;
+}
+
+//true if every character of query appears in str in order
+bool fuzzy_match(const char *query, const char *str){
+	for (; *str && *query; str++)
+	{
+		char c = *str >= 'A' && *str <= 'Z' ? *str + 32 : *str;
+		if (c == *query)
+			query++;
+	}
+	return *query == 0;
+}
+
+//resolves shortdir jump: an exact alias first, then the most frecent alias or
+//directory whose name starts with the query, then the most frecent fuzzy match
+//returns NULL if nothing matches
+const char *shortdir_find(char *query){
+	shortdir_refresh();
+	struct shortdir_entry *e = *shortdir_name_link(query);
+	if (e)
+		return e->path;
+	if (shortdir.index_dirty)
+		shortdir_build_index();
+
+	char *lower = shortdir_lower_dup(query);
+	size_t len = strlen(lower);
+	time_t now = time(NULL);
+	const char *best = NULL;
+	double best_score = -1;
+
+	// binary search for the first key that is not smaller than the query
+	size_t lo = 0, hi = shortdir.index_count;
+	while (lo < hi)
+	{
+		size_t mid = (lo + hi) / 2;
+		if (strcmp(shortdir.index[mid].key, lower) < 0)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	for (size_t i = lo; i < shortdir.index_count && strncmp(shortdir.index[i].key, lower, len) == 0; i++)
+	{
+		double score = shortdir_frecency(shortdir.index[i].path, now);
+		if (score > best_score)
+		{
+			best_score = score;
+			best = shortdir.index[i].path;
+		}
+	}
+
+	if (best == NULL)
+	{
+		for (size_t i = 0; i < shortdir.index_count; i++)
+		{
+			if (!fuzzy_match(lower, shortdir.index[i].path))
+				continue;
+			double score = shortdir_frecency(shortdir.index[i].path, now);
+			if (score > best_score)
+			{
+				best_score = score;
+				best = shortdir.index[i].path;
+			}
+		}
+	}
+	free(lower);
+	if (best == NULL)
+		printf("There is no associated path with the given name\n");
+	return best;
+}
+// QUESTION 2 HELPER METHODS END //
+
 
 // QUESTION 3 HELPER METHODS START //
 
-//since the search is case-insensitive all the words are replaced with lower versions
-char* to_lower_case(char* word){
-   char *new_word = malloc(100);
-   strcpy(new_word, word);
+//the input is mmap'd (or read in large blocks when it is not a regular file)
+//and processed in chunks that end on a line boundary
+//a single word is found by scanning for its first letter 16 bytes at a time with SSE2,
+//several words go through one Aho-Corasick automaton and regex patterns are compiled once,
+//the text is copied through unchanged and the output is written in 1 MB chunks
+struct hl_pattern
+{
+	char *word;		// lower case, NULL for regex patterns
+	size_t word_len;
+	regex_t regex;
+	char *color;
+	size_t color_len;
+};
+
+//Aho-Corasick automaton over lower case bytes with every transition filled in
+struct ac_node
+{
+	int next[256];
+	int out;	// pattern ending at this node, -1 if none
+	int dict;	// closest node on the failure chain with an output, -1 if none
+};
+
+struct highlighter
+{
+	struct hl_pattern *patterns;
+	int pattern_count;
+	bool has_regex;
+	struct ac_node *nodes;
+	int node_count;
+};
+
+//a match found in a chunk, matches are resolved leftmost-longest before they are printed
+struct hl_span
+{
+	size_t start;
+	size_t end;
+	int pattern;
+};
+
+//output buffer, flushed to fd when full, kept in memory when fd is -1
+struct outbuf
+{
+	char *data;
+	size_t len;
+	size_t cap;
+	int fd;
+};
+
+#define OUTBUF_SIZE (1 << 20)
+#define HL_CHUNK_SIZE (4 << 20)
+#define COLOR_RESET "\033[0m"
+
+static inline char ascii_lower(char c){
+	return c >= 'A' && c <= 'Z' ? c + 32 : c;
+}
+
+static inline bool is_space(char c){
+	return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\v' || c == '\f';
+}
+
+void outbuf_flush(struct outbuf *out){
+	if (out->fd != -1 && out->len > 0)
+	{
+		write_all(out->fd, out->data, out->len);
+		out->len = 0;
+	}
+}
+
+void outbuf_put(struct outbuf *out, const char *data, size_t len){
+	if (out->len + len > out->cap)
+	{
+		outbuf_flush(out);
+		if (out->fd != -1 && len >= out->cap)
+		{
+			write_all(out->fd, data, len); // large spans go out without a copy
+			return;
+		}
+		while (out->len + len > out->cap)
+		{
+			out->cap *= 2;
+			out->data = realloc(out->data, out->cap);
+		}
+	}
+	memcpy(out->data + out->len, data, len);
+	out->len += len;
+}
+
+//escape sequence of a color given as r, g or b, a 256-color number 0-255
+//or a #rrggbb truecolor value, the string has to be freed
+//NULL if the color is unknown
+char *color_escape(const char *color){
+	char escape[32];
+	char *end;
+	if (strcmp(color, "r") == 0)
+		return strdup("\033[;31m");
+	if (strcmp(color, "g") == 0)
+		return strdup("\033[;32m");
+	if (strcmp(color, "b") == 0)
+		return strdup("\033[;34m");
+	if (color[0] == '#' && strlen(color) == 7)
+	{
+		long rgb = strtol(color + 1, &end, 16);
+		if (*end != 0)
+			return NULL;
+		snprintf(escape, sizeof(escape), "\033[38;2;%ld;%ld;%ldm", (rgb >> 16) & 255, (rgb >> 8) & 255, rgb & 255);
+		return strdup(escape);
+	}
+	long n = strtol(color, &end, 10);
+	if (color[0] == 0 || *end != 0 || n < 0 || n > 255)
+		return NULL;
+	snprintf(escape, sizeof(escape), "\033[38;5;%ldm", n);
+	return strdup(escape);
+}
+
+//adds a word or a regex to the highlighter
+//returns -1 after printing the error if the color or the regex is invalid
+int highlighter_add(struct highlighter *h, const char *pattern, const char *color, bool is_regex){
+	struct hl_pattern pat;
+	memset(&pat, 0, sizeof(pat));
+	pat.color = color_escape(color);
+	if (pat.color == NULL)
+	{
+		printf("Unknown color %s, use r, g, b, 0-255 or #rrggbb\n", color);
+		return -1;
+	}
+	pat.color_len = strlen(pat.color);
+
+	if (is_regex)
+	{
+		int r = regcomp(&pat.regex, pattern, REG_EXTENDED | REG_ICASE | REG_NEWLINE);
+		if (r != 0)
+		{
+			char msg[256];
+			regerror(r, &pat.regex, msg, sizeof(msg));
+			printf("-%s: highlight: %s: %s\n", sysname, pattern, msg);
+			free(pat.color);
+			return -1;
+		}
+		h->has_regex = true;
+	}
+	else
+	{
+		pat.word_len = strlen(pattern);
+		if (pat.word_len == 0)
+		{
+			printf("Error with the argument format\n");
+			free(pat.color);
+			return -1;
+		}
+		pat.word = strdup(pattern);
+		for (size_t i = 0; i < pat.word_len; i++)
+			pat.word[i] = ascii_lower(pat.word[i]);
+	}
+	h->patterns = realloc(h->patterns, sizeof(struct hl_pattern) * (h->pattern_count + 1));
+	h->patterns[h->pattern_count++] = pat;
+	return 0;
+}
+
+int ac_new_node(struct highlighter *h){
+	h->nodes = realloc(h->nodes, sizeof(struct ac_node) * (h->node_count + 1));
+	struct ac_node *node = &h->nodes[h->node_count];
+	memset(node->next, -1, sizeof(node->next));
+	node->out = -1;
+	node->dict = -1;
+	return h->node_count++;
+}
+
+//builds the Aho-Corasick automaton when there is more than one word
+void highlighter_compile(struct highlighter *h){
+	int words = 0;
+	for (int i = 0; i < h->pattern_count; i++)
+		if (h->patterns[i].word)
+			words++;
+	if (words < 2 && !(words == 1 && h->has_regex))
+		return; // a single word uses the SSE2 scanner
+
+	ac_new_node(h);
+	for (int i = 0; i < h->pattern_count; i++)
+	{
+		struct hl_pattern *pat = &h->patterns[i];
+		if (pat->word == NULL)
+			continue;
+		int state = 0;
+		for (size_t j = 0; j < pat->word_len; j++)
+		{
+			unsigned char c = pat->word[j];
+			if (h->nodes[state].next[c] == -1)
+			{
+				int child = ac_new_node(h);
+				h->nodes[state].next[c] = child;
+			}
+			state = h->nodes[state].next[c];
+		}
+		if (h->nodes[state].out == -1)
+			h->nodes[state].out = i; // the first of duplicate words wins
+	}
+
+	// breadth first: failure links, dictionary links and the missing transitions
+	int *queue = malloc(sizeof(int) * h->node_count);
+	int *fail = calloc(h->node_count, sizeof(int));
+	int head = 0, tail = 0;
+	for (int c = 0; c < 256; c++)
+	{
+		int child = h->nodes[0].next[c];
+		if (child == -1)
+			h->nodes[0].next[c] = 0;
+		else
+			queue[tail++] = child;
+	}
+	while (head < tail)
+	{
+		int state = queue[head++];
+		int f = fail[state];
+		h->nodes[state].dict = h->nodes[f].out != -1 ? f : h->nodes[f].dict;
+		for (int c = 0; c < 256; c++)
+		{
+			int child = h->nodes[state].next[c];
+			if (child == -1)
+				h->nodes[state].next[c] = h->nodes[f].next[c];
+			else
+			{
+				fail[child] = h->nodes[f].next[c];
+				queue[tail++] = child;
+			}
+		}
+	}
+	free(queue);
+	free(fail);
+}
+
+void highlighter_free(struct highlighter *h){
+	for (int i = 0; i < h->pattern_count; i++)
+	{
+		if (h->patterns[i].word)
+			free(h->patterns[i].word);
+		else
+			regfree(&h->patterns[i].regex);
+		free(h->patterns[i].color);
+	}
+	free(h->patterns);
+	free(h->nodes);
+	memset(h, 0, sizeof(*h));
+}
+
+//returns the first byte in [p, end) equal to lo or up, NULL if there is none
+static const char *find_either(const char *p, const char *end, char lo, char up){
+#ifdef __SSE2__
+	__m128i vlo = _mm_set1_epi8(lo), vup = _mm_set1_epi8(up);
+	while (end - p >= 16)
+	{
+		__m128i block = _mm_loadu_si128((const __m128i *)p);
+		int mask = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(block, vlo), _mm_cmpeq_epi8(block, vup)));
+		if (mask)
+			return p + __builtin_ctz(mask);
+		p += 16;
+	}
+#endif
+	for (; p < end; p++)
+		if (*p == lo || *p == up)
+			return p;
+	return NULL;
+}
+
+void hl_emit(struct hl_pattern *pat, const char *text, size_t len, struct outbuf *out){
+	outbuf_put(out, pat->color, pat->color_len);
+	outbuf_put(out, text, len);
+	outbuf_put(out, COLOR_RESET, sizeof(COLOR_RESET) - 1);
+}
+
+//highlights every whitespace delimited, case-insensitive occurrence of a single word in text
+void highlight_word_chunk(struct hl_pattern *pat, const char *text, size_t len, struct outbuf *out){
+	const char *end = text + len;
+	const char *emitted = text; // everything before this is already in out
+	const char *p = text;
+	char lo = pat->word[0];
+	char up = lo >= 'a' && lo <= 'z' ? lo - 32 : lo;
+
+	while ((p = find_either(p, end, lo, up)) != NULL)
+	{
+		const char *word_end = p + pat->word_len;
+		bool match = (p == text || is_space(p[-1])) && word_end <= end && (word_end == end || is_space(*word_end));
+		for (size_t i = 1; match && i < pat->word_len; i++)
+			match = ascii_lower(p[i]) == pat->word[i];
+		if (!match)
+		{
+			p++;
+			continue;
+		}
+		outbuf_put(out, emitted, p - emitted);
+		hl_emit(pat, p, pat->word_len, out);
+		emitted = p = word_end;
+	}
+	outbuf_put(out, emitted, end - emitted);
+}
+
+int hl_span_compare(const void *a, const void *b){
+	const struct hl_span *x = a, *y = b;
+	if (x->start != y->start)
+		return x->start < y->start ? -1 : 1;
+	if (x->end != y->end)
+		return x->end > y->end ? -1 : 1; // longest first
+	return x->pattern - y->pattern;
+}
+
+void hl_add_span(struct hl_span **spans, size_t *count, size_t *cap, size_t start, size_t end, int pattern){
+	if (*count == *cap)
+	{
+		*cap = *cap ? *cap * 2 : 256;
+		*spans = realloc(*spans, sizeof(struct hl_span) * *cap);
+	}
+	(*spans)[(*count)++] = (struct hl_span){start, end, pattern};
+}
+
+//highlights every pattern in text, text has to start at the beginning of a line
+//all words are found in one pass over the automaton, each regex in one pass of regexec
+void highlight_chunk(struct highlighter *h, const char *text, size_t len, struct outbuf *out){
+	if (h->nodes == NULL && !h->has_regex)
+	{
+		highlight_word_chunk(&h->patterns[0], text, len, out);
+		return;
+	}
+
+	struct hl_span *spans = NULL;
+	size_t count = 0, cap = 0;
+	if (h->nodes)
+	{
+		int state = 0;
+		for (size_t i = 0; i < len; i++)
+		{
+			state = h->nodes[state].next[(unsigned char)ascii_lower(text[i])];
+			int match = h->nodes[state].out != -1 ? state : h->nodes[state].dict;
+			for (; match != -1; match = h->nodes[match].dict)
+			{
+				int pattern = h->nodes[match].out;
+				size_t start = i + 1 - h->patterns[pattern].word_len;
+				if ((start == 0 || is_space(text[start - 1])) && (i + 1 == len || is_space(text[i + 1])))
+					hl_add_span(&spans, &count, &cap, start, i + 1, pattern);
+			}
+		}
+	}
+	for (int p = 0; p < h->pattern_count; p++)
+	{
+		if (h->patterns[p].word)
+			continue;
+		regmatch_t m;
+		size_t offset = 0;
+		while (offset < len)
+		{
+			m.rm_so = offset;
+			m.rm_eo = len;
+			int flags = REG_STARTEND | (offset > 0 && text[offset - 1] != '\n' ? REG_NOTBOL : 0);
+			if (regexec(&h->patterns[p].regex, text, 1, &m, flags) != 0)
+				break;
+			if (m.rm_eo > m.rm_so)
+				hl_add_span(&spans, &count, &cap, m.rm_so, m.rm_eo, p);
+			offset = m.rm_eo > m.rm_so ? (size_t)m.rm_eo : (size_t)m.rm_so + 1;
+		}
+	}
+
+	// leftmost-longest, overlapping matches are dropped
+	qsort(spans, count, sizeof(struct hl_span), hl_span_compare);
+	size_t emitted = 0;
+	for (size_t i = 0; i < count; i++)
+	{
+		if (spans[i].start < emitted)
+			continue;
+		outbuf_put(out, text + emitted, spans[i].start - emitted);
+		hl_emit(&h->patterns[spans[i].pattern], text + spans[i].start, spans[i].end - spans[i].start, out);
+		emitted = spans[i].end;
+	}
+	outbuf_put(out, text + emitted, len - emitted);
+	free(spans);
+}
+
+//hands out the input in chunks that end after a newline
+//regular files are mmap'd, other inputs are read and a partial last line is carried over
+struct hl_source
+{
+	int fd;
+	char *map;
+	size_t size;
+	size_t pos;
+	char *buf;
+	size_t len;
+	size_t cap;
+	bool eof;
+};
+
+void hl_source_open(struct hl_source *src, int fd){
+	struct stat st;
+	memset(src, 0, sizeof(*src));
+	src->fd = fd;
+	if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0)
+	{
+		src->map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (src->map == MAP_FAILED)
+			src->map = NULL;
+		else
+		{
+			src->size = st.st_size;
+			madvise(src->map, src->size, MADV_SEQUENTIAL);
+			return;
+		}
+	}
+	src->cap = OUTBUF_SIZE;
+	src->buf = malloc(src->cap);
+}
+
+void hl_source_close(struct hl_source *src){
+	if (src->map)
+		munmap(src->map, src->size);
+	free(src->buf);
+}
+
+//returns the next chunk in text/len, *owned is set when the chunk has to be freed by the caller
+//returns false at the end of the input
+bool hl_next_chunk(struct hl_source *src, const char **text, size_t *len, char **owned){
+	*owned = NULL;
+	if (src->map)
+	{
+		if (src->pos >= src->size)
+			return false;
+		size_t end = src->pos + HL_CHUNK_SIZE < src->size ? src->pos + HL_CHUNK_SIZE : src->size;
+		char *nl = end < src->size ? memchr(src->map + end, '\n', src->size - end) : NULL;
+		end = nl ? (size_t)(nl - src->map + 1) : src->size;
+		*text = src->map + src->pos;
+		*len = end - src->pos;
+		src->pos = end;
+		return true;
+	}
+
+	// every read that completes a line produces a chunk, so pipes stay responsive
+	while (1)
+	{
+		if (src->eof)
+		{
+			if (src->len == 0)
+				return false;
+			*text = *owned = src->buf;
+			*len = src->len;
+			src->buf = malloc(src->cap);
+			src->len = 0;
+			return true;
+		}
+		if (src->len == src->cap)
+		{
+			src->cap *= 2;
+			src->buf = realloc(src->buf, src->cap);
+		}
+		ssize_t n = read(src->fd, src->buf + src->len, src->cap - src->len);
+		if (n == -1 && errno == EINTR)
+			continue;
+		if (n <= 0)
+		{
+			src->eof = true;
+			continue;
+		}
+		src->len += n;
+		char *nl = memrchr(src->buf + src->len - n, '\n', n);
+		if (nl == NULL)
+			continue;
+		size_t complete = nl - src->buf + 1;
+		char *rest = malloc(src->cap);
+		memcpy(rest, src->buf + complete, src->len - complete);
+		*text = *owned = src->buf;
+		*len = complete;
+		src->buf = rest;
+		src->len -= complete;
+		return true;
+	}
+}
+
+//parallel highlighting: workers take chunks in input order and render them into memory,
+//the calling thread writes the rendered chunks out in the same order
+//at most slot_count chunks are in flight, so memory stays bounded
+struct hl_slot
+{
+	struct outbuf out;
+	bool ready;
+};
+
+struct hl_pool
+{
+	struct highlighter *h;
+	struct hl_source *src;
+	pthread_mutex_t lock;
+	pthread_cond_t slot_free;
+	pthread_cond_t slot_ready;
+	struct hl_slot *slots;
+	size_t slot_count;
+	size_t next_chunk;	// index of the next chunk a worker will take
+	size_t written;		// chunks already written
+	size_t chunk_total; // known once the input is exhausted
+};
+
+void *hl_worker(void *arg){
+	struct hl_pool *pool = arg;
+	pthread_mutex_lock(&pool->lock);
+	while (1)
+	{
+		while (pool->next_chunk >= pool->written + pool->slot_count && pool->chunk_total == SIZE_MAX)
+			pthread_cond_wait(&pool->slot_free, &pool->lock);
+
+		const char *text;
+		size_t len;
+		char *owned;
+		if (pool->chunk_total != SIZE_MAX || !hl_next_chunk(pool->src, &text, &len, &owned))
+		{
+			pool->chunk_total = pool->next_chunk;
+			pthread_cond_broadcast(&pool->slot_ready);
+			pthread_cond_broadcast(&pool->slot_free);
+			break;
+		}
+		size_t index = pool->next_chunk++;
+		pthread_mutex_unlock(&pool->lock);
+
+		struct outbuf out = {malloc(len + len / 8 + 256), 0, len + len / 8 + 256, -1};
+		highlight_chunk(pool->h, text, len, &out);
+		free(owned);
+
+		pthread_mutex_lock(&pool->lock);
+		struct hl_slot *slot = &pool->slots[index % pool->slot_count];
+		slot->out = out;
+		slot->ready = true;
+		pthread_cond_broadcast(&pool->slot_ready);
+	}
+	pthread_mutex_unlock(&pool->lock);
+	return NULL;
+}
+
+//highlights everything readable from fd with the given number of worker threads
+//the output is identical to the serial path, returns -1 if the input can not be read
+int highlight_fd(struct highlighter *h, int fd, struct outbuf *out, int jobs){
+	struct hl_source src;
+	const char *text;
+	size_t len;
+	char *owned;
+
+	hl_source_open(&src, fd);
+	if (jobs <= 0)
+	{
+		// one worker per core for inputs larger than a couple of chunks
+		long cores = sysconf(_SC_NPROCESSORS_ONLN);
+		jobs = src.map && src.size > 2 * HL_CHUNK_SIZE && cores > 1 ? cores : 1;
+	}
+	if (jobs == 1)
+	{
+		while (hl_next_chunk(&src, &text, &len, &owned))
+		{
+			highlight_chunk(h, text, len, out);
+			free(owned);
+		}
+		hl_source_close(&src);
+		return 0;
+	}
+
+	struct hl_pool pool;
+	memset(&pool, 0, sizeof(pool));
+	pool.h = h;
+	pool.src = &src;
+	pool.slot_count = 2 * jobs;
+	pool.slots = calloc(pool.slot_count, sizeof(struct hl_slot));
+	pool.chunk_total = SIZE_MAX;
+	pthread_mutex_init(&pool.lock, NULL);
+	pthread_cond_init(&pool.slot_free, NULL);
+	pthread_cond_init(&pool.slot_ready, NULL);
+
+	pthread_t *threads = malloc(sizeof(pthread_t) * jobs);
+	for (int i = 0; i < jobs; i++)
+		pthread_create(&threads[i], NULL, hl_worker, &pool);
+
+	outbuf_flush(out);
+	pthread_mutex_lock(&pool.lock);
+	while (pool.written < pool.chunk_total)
+	{
+		struct hl_slot *slot = &pool.slots[pool.written % pool.slot_count];
+		while (!slot->ready && pool.written < pool.chunk_total)
+			pthread_cond_wait(&pool.slot_ready, &pool.lock);
+		if (!slot->ready)
+			break;
+		struct outbuf rendered = slot->out;
+		slot->ready = false;
+		pthread_mutex_unlock(&pool.lock);
+
+		outbuf_put(out, rendered.data, rendered.len);
+		free(rendered.data);
+
+		pthread_mutex_lock(&pool.lock);
+		pool.written++;
+		pthread_cond_broadcast(&pool.slot_free);
+	}
+	pthread_mutex_unlock(&pool.lock);
+
+	for (int i = 0; i < jobs; i++)
+		pthread_join(threads[i], NULL);
+	free(threads);
+	free(pool.slots);
+	pthread_mutex_destroy(&pool.lock);
+	pthread_cond_destroy(&pool.slot_free);
+	pthread_cond_destroy(&pool.slot_ready);
+	hl_source_close(&src);
+	return 0;
+}
+
+//highlights a file, or stdin when the file name is -
+//jobs is the number of worker threads, 0 picks one per core for large files
+void highlight_file(struct highlighter *h, const char *file_name, int jobs){
+	int fd = strcmp(file_name, "-") == 0 ? dup(STDIN_FILENO) : open(file_name, O_RDONLY | O_CLOEXEC);
+	if (fd == -1)
+	{
+		printf("-%s: highlight: %s: %s\n", sysname, file_name, strerror(errno));
+		return;
+	}
+	fflush(stdout);
+	struct outbuf out = {malloc(OUTBUF_SIZE), 0, OUTBUF_SIZE, STDOUT_FILENO};
+	highlight_fd(h, fd, &out, jobs);
+	outbuf_flush(&out);
+	free(out.data);
+	close(fd);
+}
+
+//the main method of the question3
+//takes a word, color char and file_name. Changes the color of every occurence of the given word in given file.
+void highlight(char *word, char* color, char* file_name){
+	struct highlighter h;
+	memset(&h, 0, sizeof(h));
+	if (highlighter_add(&h, word, color, false) == 0)
+	{
+		highlighter_compile(&h);
+		highlight_file(&h, file_name, 0);
+	}
+	highlighter_free(&h);
+}
+
+//highlight [-j N] word color file
+//highlight [-j N] [-e word color]... [-x regex color]... file
+//every pattern is highlighted in a single pass over the file using N worker threads
+void highlight_command(int argc, char *argv[]){
+	struct highlighter h;
+	memset(&h, 0, sizeof(h));
+	int jobs = 0;
+	int i = 0;
+	while (i < argc - 1)
+	{
+		if ((strcmp(argv[i], "-e") == 0 || strcmp(argv[i], "-x") == 0) && i + 2 < argc)
+		{
+			if (highlighter_add(&h, argv[i + 1], argv[i + 2], argv[i][1] == 'x') == -1)
+			{
+				highlighter_free(&h);
+				return;
+			}
+			i += 3;
+		}
+		else if (strcmp(argv[i], "-j") == 0 && i + 1 < argc && atoi(argv[i + 1]) > 0)
+		{
+			jobs = atoi(argv[i + 1]);
+			i += 2;
+		}
+		else
+			break;
+	}
+	if (h.pattern_count == 0 && i == argc - 3 && argv[i][0] != '-')
+	{
+		if (highlighter_add(&h, argv[i], argv[i + 1], false) == -1)
+		{
+			highlighter_free(&h);
+			return;
+		}
+		i += 2;
+	}
+	if (h.pattern_count == 0 || i != argc - 1)
+	{
+		printf("Error with the argument format\n");
+		printf("usage: highlight [-j N] word color file\n");
+		printf("       highlight [-j N] [-e word color]... [-x regex color]... file\n");
+		highlighter_free(&h);
+		return;
+	}
+	highlighter_compile(&h);
+	highlight_file(&h, argv[argc - 1], jobs);
+	highlighter_free(&h);
+}
+
+// QUESTION 3 HELPER METHODS END //
+
+
+// QUESTION 5 HELPER METHODS START //
+
+//the text diff works on line ids: every line is hashed once and interned so that equal
+//lines of both files share an id and comparing two lines is one integer compare
+//Myers' O(ND) algorithm is run in linear space (divide and conquer on the middle snake),
+//the histogram variant splits the files around the rarest common line first
+//the changed lines are printed as unified diff hunks
+struct diff_file
+{
+	char *name;
+	char *map;
+	size_t size;
+	const char **lines; // start of each line
+	size_t *lengths;	// without the newline
+	int *ids;
+	bool *changed;
+	int count;
+};
+
+struct diff_ctx
+{
+	struct diff_file *a;
+	struct diff_file *b;
+	int *fd;		// furthest reaching x per diagonal, forward search
+	int *bd;		// backward search
+	int *count_a;	// histogram: occurrences of each id in the current range
+	int *count_b;
+	int too_expensive;	// edit cost after which the middle snake settles for a good split
+};
+
+//maps a file and splits it into lines, an empty file has no lines
+//returns -1 after printing the error if the file can not be read
+int diff_file_open(struct diff_file *f, char *name){
+	memset(f, 0, sizeof(*f));
+	f->name = name;
+	int fd = open(name, O_RDONLY | O_CLOEXEC);
+	struct stat st;
+	if (fd == -1 || fstat(fd, &st) == -1)
+	{
+		printf("-%s: kdiff: %s: %s\n", sysname, name, strerror(errno));
+		if (fd != -1)
+			close(fd);
+		return -1;
+	}
+	f->size = st.st_size;
+	if (f->size > 0)
+	{
+		f->map = mmap(NULL, f->size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (f->map == MAP_FAILED)
+		{
+			printf("-%s: kdiff: %s: %s\n", sysname, name, strerror(errno));
+			close(fd);
+			return -1;
+		}
+		madvise(f->map, f->size, MADV_SEQUENTIAL);
+	}
+	close(fd);
+
+	size_t cap = 1024;
+	f->lines = malloc(sizeof(char *) * cap);
+	f->lengths = malloc(sizeof(size_t) * cap);
+	const char *p = f->map, *end = f->map + f->size;
+	while (p < end)
+	{
+		const char *nl = memchr(p, '\n', end - p);
+		const char *line_end = nl ? nl : end;
+		if ((size_t)f->count == cap)
+		{
+			cap *= 2;
+			f->lines = realloc(f->lines, sizeof(char *) * cap);
+			f->lengths = realloc(f->lengths, sizeof(size_t) * cap);
+		}
+		f->lines[f->count] = p;
+		f->lengths[f->count++] = line_end - p;
+		p = line_end + 1;
+	}
+	f->ids = malloc(sizeof(int) * (f->count + 1));
+	f->changed = calloc(f->count + 1, sizeof(bool));
+	return 0;
+}
+
+void diff_file_close(struct diff_file *f){
+	if (f->map)
+		munmap(f->map, f->size);
+	free(f->lines);
+	free(f->lengths);
+	free(f->ids);
+	free(f->changed);
+}
+
+//FNV-1a over a line
+uint64_t line_hash(const char *p, size_t len){
+	uint64_t h = 14695981039346656037ull;
+	for (size_t i = 0; i < len; i++)
+	{
+		h ^= (unsigned char)p[i];
+		h *= 1099511628211ull;
+	}
+	return h;
+}
+
+//gives equal lines of both files the same id, returns the number of distinct ids
+int diff_intern_lines(struct diff_file *a, struct diff_file *b){
+	size_t total = (size_t)a->count + b->count;
+	size_t cap = 16;
+	while (cap < total * 2)
+		cap *= 2;
+	// open addressing, a slot holds the id and the hash of a representative line
+	int *slot_ids = malloc(sizeof(int) * cap);
+	uint64_t *slot_hashes = malloc(sizeof(uint64_t) * cap);
+	const char **rep_lines = malloc(sizeof(char *) * (total + 1));
+	size_t *rep_lengths = malloc(sizeof(size_t) * (total + 1));
+	memset(slot_ids, -1, sizeof(int) * cap);
+	int next_id = 0;
+
+	struct diff_file *files[2] = {a, b};
+	for (int f = 0; f < 2; f++)
+	{
+		for (int i = 0; i < files[f]->count; i++)
+		{
+			const char *line = files[f]->lines[i];
+			size_t len = files[f]->lengths[i];
+			uint64_t h = line_hash(line, len);
+			size_t slot = h & (cap - 1);
+			while (slot_ids[slot] != -1)
+			{
+				int id = slot_ids[slot];
+				if (slot_hashes[slot] == h && rep_lengths[id] == len && memcmp(rep_lines[id], line, len) == 0)
+					break;
+				slot = (slot + 1) & (cap - 1);
+			}
+			if (slot_ids[slot] == -1)
+			{
+				slot_ids[slot] = next_id;
+				slot_hashes[slot] = h;
+				rep_lines[next_id] = line;
+				rep_lengths[next_id] = len;
+				next_id++;
+			}
+			files[f]->ids[i] = slot_ids[slot];
+		}
+	}
+	free(slot_ids);
+	free(slot_hashes);
+	free(rep_lines);
+	free(rep_lengths);
+	return next_id;
+}
+
+//finds the middle snake of a[xoff, xlim) and b[yoff, ylim) and returns a split point on it
+//searching forward from the top-left and backward from the bottom-right until the paths overlap
+//like GNU diff, once the cost reaches too_expensive the furthest reaching diagonal is used
+//instead, the diff is no longer minimal but the time stays near (N+M)*too_expensive
+void diff_middle_snake(struct diff_ctx *c, int xoff, int xlim, int yoff, int ylim, int *xmid, int *ymid){
+	const int *xv = c->a->ids, *yv = c->b->ids;
+	int *fd = c->fd, *bd = c->bd;
+	const int dmin = xoff - ylim, dmax = xlim - yoff;
+	const int fmid = xoff - yoff, bmid = xlim - ylim;
+	int fmin = fmid, fmax = fmid, bmin = bmid, bmax = bmid;
+	bool odd = (fmid - bmid) & 1;
+
+	fd[fmid] = xoff;
+	bd[bmid] = xlim;
+	for (int cost = 1;; cost++)
+	{
+		int d;
+		// extend the forward search by one edit on every diagonal
+		if (fmin > dmin)
+			fd[--fmin - 1] = -1;
+		else
+			++fmin;
+		if (fmax < dmax)
+			fd[++fmax + 1] = -1;
+		else
+			--fmax;
+		for (d = fmax; d >= fmin; d -= 2)
+		{
+			int x, y, tlo = fd[d - 1], thi = fd[d + 1];
+			int x0 = tlo < thi ? thi : tlo + 1;
+			for (x = x0, y = x0 - d; x < xlim && y < ylim && xv[x] == yv[y]; x++, y++)
+				;
+			fd[d] = x;
+			if (odd && bmin <= d && d <= bmax && bd[d] <= x)
+			{
+				*xmid = x;
+				*ymid = y;
+				return;
+			}
+		}
+		// the same for the backward search
+		if (bmin > dmin)
+			bd[--bmin - 1] = INT_MAX;
+		else
+			++bmin;
+		if (bmax < dmax)
+			bd[++bmax + 1] = INT_MAX;
+		else
+			--bmax;
+		for (d = bmax; d >= bmin; d -= 2)
+		{
+			int x, y, tlo = bd[d - 1], thi = bd[d + 1];
+			int x0 = tlo < thi ? tlo : thi - 1;
+			for (x = x0, y = x0 - d; xoff < x && yoff < y && xv[x - 1] == yv[y - 1]; x--, y--)
+				;
+			bd[d] = x;
+			if (!odd && fmin <= d && d <= fmax && x <= fd[d])
+			{
+				*xmid = x;
+				*ymid = y;
+				return;
+			}
+		}
+
+		if (cost < c->too_expensive)
+			continue;
+		// too expensive: split on the forward diagonal furthest from the top-left
+		// or the backward one furthest from the bottom-right, whichever got further
+		int fxybest = -1, fxbest = xoff, bxybest = INT_MAX, bxbest = xlim;
+		for (d = fmax; d >= fmin; d -= 2)
+		{
+			int x = fd[d] < xlim ? fd[d] : xlim, y = x - d;
+			if (y > ylim)
+				x = ylim + d, y = ylim;
+			if (x + y > fxybest)
+				fxybest = x + y, fxbest = x;
+		}
+		for (d = bmax; d >= bmin; d -= 2)
+		{
+			int x = bd[d] > xoff ? bd[d] : xoff, y = x - d;
+			if (y < yoff)
+				x = yoff + d, y = yoff;
+			if (x + y < bxybest)
+				bxybest = x + y, bxbest = x;
+		}
+		if ((xlim + ylim) - bxybest < fxybest - (xoff + yoff))
+		{
+			*xmid = fxbest;
+			*ymid = fxybest - fxbest;
+		}
+		else
+		{
+			*xmid = bxbest;
+			*ymid = bxybest - bxbest;
+		}
+		return;
+	}
+}
+
+//marks the lines of a[xoff, xlim) and b[yoff, ylim) that are not in their longest common subsequence
+void diff_myers(struct diff_ctx *c, int xoff, int xlim, int yoff, int ylim){
+	const int *xv = c->a->ids, *yv = c->b->ids;
+	while (xoff < xlim && yoff < ylim && xv[xoff] == yv[yoff])
+		xoff++, yoff++; // common prefix
+	while (xoff < xlim && yoff < ylim && xv[xlim - 1] == yv[ylim - 1])
+		xlim--, ylim--; // common suffix
+
+	if (xoff == xlim)
+	{
+		while (yoff < ylim)
+			c->b->changed[yoff++] = true;
+		return;
+	}
+	if (yoff == ylim)
+	{
+		while (xoff < xlim)
+			c->a->changed[xoff++] = true;
+		return;
+	}
+	int xmid, ymid;
+	diff_middle_snake(c, xoff, xlim, yoff, ylim, &xmid, &ymid);
+	diff_myers(c, xoff, xmid, yoff, ymid);
+	diff_myers(c, xmid, xlim, ymid, ylim);
+}
+
+//histogram diff: the common line that occurs least often in the range is used as an anchor,
+//the match around it is extended and both sides are diffed recursively
+//ranges without a rare enough common line fall back to Myers
+void diff_histogram(struct diff_ctx *c, int xoff, int xlim, int yoff, int ylim, int depth){
+	const int *xv = c->a->ids, *yv = c->b->ids;
+	while (xoff < xlim && yoff < ylim && xv[xoff] == yv[yoff])
+		xoff++, yoff++;
+	while (xoff < xlim && yoff < ylim && xv[xlim - 1] == yv[ylim - 1])
+		xlim--, ylim--;
+	if (xoff == xlim || yoff == ylim || depth > 64)
+	{
+		diff_myers(c, xoff, xlim, yoff, ylim);
+		return;
+	}
+
+	for (int i = xoff; i < xlim; i++)
+		c->count_a[xv[i]]++;
+	for (int j = yoff; j < ylim; j++)
+		c->count_b[yv[j]]++;
+
+	int best_j = -1, best_count = INT_MAX;
+	for (int j = yoff; j < ylim; j++)
+	{
+		int id = yv[j];
+		if (c->count_a[id] > 0 && c->count_a[id] + c->count_b[id] < best_count)
+		{
+			best_count = c->count_a[id] + c->count_b[id];
+			best_j = j;
+		}
+	}
+	for (int i = xoff; i < xlim; i++)
+		c->count_a[xv[i]] = 0;
+	for (int j = yoff; j < ylim; j++)
+		c->count_b[yv[j]] = 0;
+
+	if (best_j == -1)
+	{
+		// no common line at all, every line changed
+		while (xoff < xlim)
+			c->a->changed[xoff++] = true;
+		while (yoff < ylim)
+			c->b->changed[yoff++] = true;
+		return;
+	}
+	if (best_count > 64)
+	{
+		diff_myers(c, xoff, xlim, yoff, ylim);
+		return;
+	}
+	int best_i = xoff;
+	while (xv[best_i] != yv[best_j])
+		best_i++;
+
+	// grow the anchor into the longest run of equal lines around it
+	int i0 = best_i, j0 = best_j, i1 = best_i + 1, j1 = best_j + 1;
+	while (i0 > xoff && j0 > yoff && xv[i0 - 1] == yv[j0 - 1])
+		i0--, j0--;
+	while (i1 < xlim && j1 < ylim && xv[i1] == yv[j1])
+		i1++, j1++;
+	diff_histogram(c, xoff, i0, yoff, j0, depth + 1);
+	diff_histogram(c, i1, xlim, j1, ylim, depth + 1);
+}
+
+void diff_print_lines(char prefix, struct diff_file *f, int from, int to){
+	for (int i = from; i < to; i++)
+	{
+		putchar(prefix);
+		fwrite(f->lines[i], 1, f->lengths[i], stdout);
+		putchar('\n');
+	}
+}
+
+//range of a hunk header, a single line omits the count
+void diff_print_range(char sign, int start, int count){
+	if (count == 1)
+		printf(" %c%d", sign, start + 1);
+	else
+		printf(" %c%d,%d", sign, count == 0 ? start : start + 1, count);
+}
+
+//prints the changed lines as unified diff hunks, returns the number of changed lines
+long diff_print_hunks(struct diff_file *a, struct diff_file *b, int context){
+	long changed_lines = 0;
+	int i = 0, j = 0;
+	int prev_i = 0; // end of the previous hunk, context lines are never shared
+	bool header = false;
+	while (i < a->count || j < b->count)
+	{
+		if (i < a->count && j < b->count && !a->changed[i] && !b->changed[j])
+		{
+			i++, j++;
+			continue;
+		}
+		// a hunk starts context lines before this change and ends when 2 * context unchanged lines follow
+		int back = i - prev_i < context ? i - prev_i : context;
+		int hunk_i = i - back, hunk_j = j - back;
+		int end_i = i, end_j = j;
+		while (1)
+		{
+			while (end_i < a->count && a->changed[end_i])
+				end_i++;
+			while (end_j < b->count && b->changed[end_j])
+				end_j++;
+			int same = 0;
+			while (end_i + same < a->count && end_j + same < b->count && same <= 2 * context &&
+				   !a->changed[end_i + same] && !b->changed[end_j + same])
+				same++;
+			bool more = (end_i + same < a->count && a->changed[end_i + same]) ||
+						(end_j + same < b->count && b->changed[end_j + same]);
+			if (!more || same > 2 * context)
+			{
+				int tail = same < context ? same : context;
+				end_i += tail;
+				end_j += tail;
+				break;
+			}
+			end_i += same;
+			end_j += same;
+		}
+
+		if (!header)
+		{
+			printf("--- %s\n+++ %s\n", a->name, b->name);
+			header = true;
+		}
+		printf("@@");
+		diff_print_range('-', hunk_i, end_i - hunk_i);
+		diff_print_range('+', hunk_j, end_j - hunk_j);
+		printf(" @@\n");
+
+		// walk the hunk: context lines, then the deletions and insertions of each change
+		int x = hunk_i, y = hunk_j;
+		while (x < end_i || y < end_j)
+		{
+			if (x < end_i && y < end_j && !a->changed[x] && !b->changed[y])
+			{
+				diff_print_lines(' ', a, x, x + 1);
+				x++, y++;
+				continue;
+			}
+			int del_end = x, ins_end = y;
+			while (del_end < end_i && a->changed[del_end])
+				del_end++;
+			while (ins_end < end_j && b->changed[ins_end])
+				ins_end++;
+			diff_print_lines('-', a, x, del_end);
+			diff_print_lines('+', b, y, ins_end);
+			changed_lines += (del_end - x) + (ins_end - y);
+			x = del_end;
+			y = ins_end;
+		}
+		i = prev_i = end_i;
+		j = end_j;
+	}
+	return changed_lines;
+}
+
+//takes two files in .txt format and displays the different lines as a unified diff
+void compare_txt_files(char *txt1, char *txt2, int algorithm, int context){
+   int l1 = strlen(txt1);
+   int l2 = strlen(txt2);
+
+   if(l1<4 || txt1[l1-4]!='.' || txt1[l1-3]!='t' || txt1[l1-2]!='x' || txt1[l1-1]!='t' || 
+   l2<4 || txt2[l2-4]!='.' || txt2[l2-3]!='t' || txt2[l2-2]!='x' || txt2[l2-1]!='t'){
+      printf("File should be in txt format\n");
+      return;
+   }
+	if (kdiff_same_content(txt1, txt2))
+	{
+		printf("The two files are identical\n");
+		return;
+	}
+
+	struct diff_file a, b;
+	if (diff_file_open(&a, txt1) == -1)
+		return;
+	if (diff_file_open(&b, txt2) == -1)
+	{
+		diff_file_close(&a);
+		return;
+	}
+	if (context < 0)
+		context = 0;
+
+	int id_count = diff_intern_lines(&a, &b);
+	struct diff_ctx c;
+	memset(&c, 0, sizeof(c));
+	c.a = &a;
+	c.b = &b;
+	// diagonals run from -b.count to a.count, one extra on each side
+	int *fd_base = malloc(sizeof(int) * (a.count + b.count + 3));
+	int *bd_base = malloc(sizeof(int) * (a.count + b.count + 3));
+	c.fd = fd_base + b.count + 1;
+	c.bd = bd_base + b.count + 1;
+	// about the square root of the diagonal count, at least 4096 like GNU diff
+	c.too_expensive = 1;
+	for (int diagonals = a.count + b.count + 3; diagonals != 0; diagonals >>= 2)
+		c.too_expensive <<= 1;
+	if (c.too_expensive < 4096)
+		c.too_expensive = 4096;
+	if (algorithm == DIFF_HISTOGRAM)
+	{
+		c.count_a = calloc(id_count + 1, sizeof(int));
+		c.count_b = calloc(id_count + 1, sizeof(int));
+		diff_histogram(&c, 0, a.count, 0, b.count, 0);
+	}
+	else
+		diff_myers(&c, 0, a.count, 0, b.count);
+
+	long mismatch = diff_print_hunks(&a, &b, context);
+	if(mismatch==0){
+		printf("The two files are identical\n");
+	}else{
+		printf("%ld different lines found\n", mismatch);
+	}
+
+	free(fd_base);
+	free(bd_base);
+	free(c.count_a);
+	free(c.count_b);
+	diff_file_close(&a);
+	diff_file_close(&b);
+}
+
+#define BIN_WINDOW (64UL << 20) // bytes of each file looked at per step
+
+//number of positions where x and y differ, 64 bytes at a time
+unsigned long long bin_count_mismatch(const unsigned char *x, const unsigned char *y, size_t n){
+	unsigned long long count = 0;
+	size_t i = 0;
+#ifdef __SSE2__
+	for (; i + 64 <= n; i += 64)
+	{
+		uint64_t eq = 0;
+		for (int k = 0; k < 4; k++)
+		{
+			__m128i vx = _mm_loadu_si128((const __m128i *)(x + i + 16 * k));
+			__m128i vy = _mm_loadu_si128((const __m128i *)(y + i + 16 * k));
+			eq |= (uint64_t)(uint16_t)_mm_movemask_epi8(_mm_cmpeq_epi8(vx, vy)) << (16 * k);
+		}
+		count += __builtin_popcountll(~eq);
+	}
+#endif
+	for (; i < n; i++)
+		count += x[i] != y[i];
+	return count;
+}
+
+//index of the first position where (x[i] == y[i]) == equal, n if there is none
+size_t bin_span(const unsigned char *x, const unsigned char *y, size_t n, bool equal){
+	size_t i = 0;
+#ifdef __SSE2__
+	for (; i + 16 <= n; i += 16)
+	{
+		__m128i vx = _mm_loadu_si128((const __m128i *)(x + i));
+		__m128i vy = _mm_loadu_si128((const __m128i *)(y + i));
+		int mask = _mm_movemask_epi8(_mm_cmpeq_epi8(vx, vy));
+		if (!equal)
+			mask ^= 0xffff;
+		if (mask)
+			return i + __builtin_ctz(mask);
+	}
+#endif
+	for (; i < n; i++)
+		if ((x[i] == y[i]) == equal)
+			return i;
+	return n;
+}
+
+//one file being compared, regular files are mapped window by window, anything else is read
+struct bin_file
+{
+	const char *name;
+	int fd;
+	bool mapped;
+	off_t size;
+	unsigned char *window;
+	size_t window_len;
+};
+
+int bin_file_open(struct bin_file *f, const char *name){
+	struct stat st;
+	memset(f, 0, sizeof(*f));
+	f->name = name;
+	f->fd = open(name, O_RDONLY | O_CLOEXEC);
+	if (f->fd == -1 || fstat(f->fd, &st) == -1 || (f->size = lseek(f->fd, 0, SEEK_END)) == -1)
+	{
+		printf("-%s: kdiff: %s: %s\n", sysname, name, strerror(errno));
+		if (f->fd != -1)
+			close(f->fd);
+		return -1;
+	}
+	f->mapped = S_ISREG(st.st_mode);
+	if (!f->mapped)
+		f->window = malloc(BIN_WINDOW);
+	posix_fadvise(f->fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+	return 0;
+}
+
+//makes bytes [offset, offset + len) of the file available in f->window
+int bin_file_window(struct bin_file *f, off_t offset, size_t len){
+	if (f->mapped)
+	{
+		if (f->window)
+			munmap(f->window, f->window_len);
+		f->window = NULL;
+		void *map = mmap(NULL, len, PROT_READ, MAP_PRIVATE, f->fd, offset);
+		if (map == MAP_FAILED)
+			goto fail;
+		// advice values are not flags, each one needs its own call
+		madvise(map, len, MADV_SEQUENTIAL);
+		madvise(map, len, MADV_WILLNEED);
+		f->window = map;
+		f->window_len = len;
+		return 0;
+	}
+	for (size_t done = 0; done < len;)
+	{
+		ssize_t n = pread(f->fd, f->window + done, len - done, offset + done);
+		if (n == 0)
+			errno = EIO;
+		if (n <= 0)
+		{
+			if (n == -1 && errno == EINTR)
+				continue;
+			goto fail;
+		}
+		done += n;
+	}
+	return 0;
+fail:
+	printf("-%s: kdiff: %s: %s\n", sysname, f->name, strerror(errno));
+	return -1;
+}
+
+void bin_file_close(struct bin_file *f){
+	if (f->mapped && f->window)
+		munmap(f->window, f->window_len);
+	else if (!f->mapped)
+		free(f->window);
+	close(f->fd);
+}
+
+//takes two files in any format and compares them byte by byte
+//with ranges set every run of differing bytes is printed as well
+void compare_binary_files(char *file1_name, char *file2_name, bool ranges){
+	if (kdiff_same_content(file1_name, file2_name))
+	{
+		printf("The two files are identical\n");
+		return;
+	}
+	struct bin_file a, b;
+	if (bin_file_open(&a, file1_name) == -1)
+		return;
+	if (bin_file_open(&b, file2_name) == -1)
+	{
+		bin_file_close(&a);
+		return;
+	}
+
+	off_t common = a.size < b.size ? a.size : b.size;
+	unsigned long long difference_counter = 0;
+	long long run_start = -1; // start of a run of differing bytes that may continue in the next window
+	for (off_t offset = 0; offset < common; offset += BIN_WINDOW)
+	{
+		size_t len = common - offset < (off_t)BIN_WINDOW ? (size_t)(common - offset) : BIN_WINDOW;
+		if (bin_file_window(&a, offset, len) == -1 || bin_file_window(&b, offset, len) == -1)
+		{
+			bin_file_close(&a);
+			bin_file_close(&b);
+			return;
+		}
+		if (!ranges)
+		{
+			difference_counter += bin_count_mismatch(a.window, b.window, len);
+			continue;
+		}
+		size_t i = 0;
+		while (i < len)
+		{
+			size_t next = i + bin_span(a.window + i, b.window + i, len - i, run_start != -1);
+			if (run_start == -1 && next < len)
+				run_start = offset + next;
+			else if (run_start != -1 && next < len)
+			{
+				printf("bytes %lld-%lld differ\n", run_start, (long long)(offset + next - 1));
+				difference_counter += offset + next - run_start;
+				run_start = -1;
+			}
+			i = next;
+		}
+	}
+	if (run_start != -1)
+	{
+		printf("bytes %lld-%lld differ\n", run_start, (long long)common - 1);
+		difference_counter += common - run_start;
+	}
+
+	off_t longer = a.size > b.size ? a.size : b.size;
+	if (ranges && longer > common)
+		printf("bytes %lld-%lld only in %s\n", (long long)common, (long long)longer - 1, a.size > b.size ? a.name : b.name);
+	difference_counter += longer - common;
+
+	if (difference_counter==0){
+		printf("The two files are identical\n");
+	}else{
+		printf("The two files are different in %llu bytes\n", difference_counter);
+	}
+	bin_file_close(&a);
+	bin_file_close(&b);
+}
+//before diffing, files of the same size are compared by a 64-bit streaming hash (XXH64)
+//digests are remembered in kdiff.cache keyed by (dev, inode, mtime, size)
+//so comparing unchanged files again does not read them at all
+#define XXH_P1 11400714785074694791ULL
+#define XXH_P2 14029467366897019727ULL
+#define XXH_P3 1609587929392839161ULL
+#define XXH_P4 9650029242287828579ULL
+#define XXH_P5 2870177450012600261ULL
+#define HASH_BLOCK (1UL << 20)
+
+struct xxh64_state
+{
+	uint64_t v[4];
+	uint64_t total;
+};
+
+struct hash_cache_entry
+{
+	dev_t dev;
+	ino_t ino;
+	struct timespec mtime;
+	off_t size;
+	uint64_t digest;
+	struct hash_cache_entry *next;
+};
+
+struct hash_cache
+{
+	struct hash_cache_entry **buckets;
+	size_t bucket_count;
+	size_t count;
+	size_t records;	// lines in the file, compacted when mostly stale
+	dev_t file_dev;	// identity and size of kdiff.cache when it was read
+	ino_t file_ino;
+	off_t file_size;
+} hash_cache;
+
+static inline uint64_t xxh_rotl(uint64_t x, int r){
+	return (x << r) | (x >> (64 - r));
+}
+
+static inline uint64_t xxh_read64(const unsigned char *p){
+	uint64_t v;
+	memcpy(&v, p, sizeof(v));
+	return v;
+}
+
+static inline uint64_t xxh_round(uint64_t acc, uint64_t input){
+	acc += input * XXH_P2;
+	return xxh_rotl(acc, 31) * XXH_P1;
+}
+
+static inline uint64_t xxh_merge(uint64_t acc, uint64_t val){
+	acc ^= xxh_round(0, val);
+	return acc * XXH_P1 + XXH_P4;
+}
+
+void xxh64_init(struct xxh64_state *st){
+	st->v[0] = XXH_P1 + XXH_P2;
+	st->v[1] = XXH_P2;
+	st->v[2] = 0;
+	st->v[3] = -XXH_P1;
+	st->total = 0;
+}
+
+//consumes whole 32 byte stripes, returns the number of bytes used
+size_t xxh64_update(struct xxh64_state *st, const unsigned char *p, size_t len){
+	size_t used = len & ~(size_t)31;
+	uint64_t v0 = st->v[0], v1 = st->v[1], v2 = st->v[2], v3 = st->v[3];
+	for (size_t i = 0; i < used; i += 32)
+	{
+		v0 = xxh_round(v0, xxh_read64(p + i));
+		v1 = xxh_round(v1, xxh_read64(p + i + 8));
+		v2 = xxh_round(v2, xxh_read64(p + i + 16));
+		v3 = xxh_round(v3, xxh_read64(p + i + 24));
+	}
+	st->v[0] = v0, st->v[1] = v1, st->v[2] = v2, st->v[3] = v3;
+	st->total += used;
+	return used;
+}
+
+//mixes in the last len < 32 bytes and returns the digest
+uint64_t xxh64_final(struct xxh64_state *st, const unsigned char *p, size_t len){
+	uint64_t h;
+	if (st->total >= 32)
+	{
+		h = xxh_rotl(st->v[0], 1) + xxh_rotl(st->v[1], 7) + xxh_rotl(st->v[2], 12) + xxh_rotl(st->v[3], 18);
+		for (int i = 0; i < 4; i++)
+			h = xxh_merge(h, st->v[i]);
+	}
+	else
+		h = XXH_P5;
+	h += st->total + len;
+	for (; len >= 8; p += 8, len -= 8)
+		h = xxh_rotl(h ^ xxh_round(0, xxh_read64(p)), 27) * XXH_P1 + XXH_P4;
+	if (len >= 4)
+	{
+		uint32_t k;
+		memcpy(&k, p, sizeof(k));
+		h = xxh_rotl(h ^ (k * XXH_P1), 23) * XXH_P2 + XXH_P3;
+		p += 4, len -= 4;
+	}
+	for (; len > 0; p++, len--)
+		h = xxh_rotl(h ^ (*p * XXH_P5), 11) * XXH_P1;
+	h ^= h >> 33;
+	h *= XXH_P2;
+	h ^= h >> 29;
+	h *= XXH_P3;
+	h ^= h >> 32;
+	return h;
+}
+
+//hashes the whole file in 1 MB reads, returns -1 on a read error
+int hash_fd(int fd, uint64_t *digest){
+	unsigned char *buf = malloc(HASH_BLOCK);
+	struct xxh64_state st;
+	size_t have = 0;
+	ssize_t n;
+	xxh64_init(&st);
+	posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+	while ((n = read(fd, buf + have, HASH_BLOCK - have)) != 0)
+	{
+		if (n == -1)
+		{
+			if (errno == EINTR)
+				continue;
+			free(buf);
+			return -1;
+		}
+		have += n;
+		size_t used = xxh64_update(&st, buf, have);
+		memmove(buf, buf + used, have - used);
+		have -= used;
+	}
+	*digest = xxh64_final(&st, buf, have);
+	free(buf);
+	return 0;
+}
+
+struct hash_cache_entry **hash_cache_link(dev_t dev, ino_t ino){
+	struct hash_cache_entry **link = &hash_cache.buckets[(dev * 31 + ino) % hash_cache.bucket_count];
+	while (*link && ((*link)->dev != dev || (*link)->ino != ino))
+		link = &(*link)->next;
+	return link;
+}
+
+//allocates the empty table, it doubles once the load factor passes 1
+void hash_cache_init(){
+	hash_cache.bucket_count = 64;
+	hash_cache.buckets = calloc(hash_cache.bucket_count, sizeof(struct hash_cache_entry *));
+}
+
+//a file has one entry, a newer record for the same inode replaces the old one
+void hash_cache_put(dev_t dev, ino_t ino, struct timespec mtime, off_t size, uint64_t digest){
+	if (hash_cache.count + 1 > hash_cache.bucket_count)
+	{
+		size_t old_count = hash_cache.bucket_count;
+		struct hash_cache_entry **old = hash_cache.buckets;
+		hash_cache.bucket_count = old_count * 2;
+		hash_cache.buckets = calloc(hash_cache.bucket_count, sizeof(struct hash_cache_entry *));
+		for (size_t i = 0; i < old_count; i++)
+		{
+			while (old[i])
+			{
+				struct hash_cache_entry *e = old[i];
+				old[i] = e->next;
+				struct hash_cache_entry **link = hash_cache_link(e->dev, e->ino);
+				e->next = *link;
+				*link = e;
+			}
+		}
+		free(old);
+	}
+	struct hash_cache_entry **link = hash_cache_link(dev, ino);
+	struct hash_cache_entry *e = *link;
+	if (e == NULL)
+	{
+		e = calloc(1, sizeof(struct hash_cache_entry));
+		e->dev = dev;
+		e->ino = ino;
+		*link = e;
+		hash_cache.count++;
+	}
+	e->mtime = mtime;
+	e->size = size;
+	e->digest = digest;
+}
+
+void hash_cache_clear(){
+	for (size_t i = 0; i < hash_cache.bucket_count; i++)
+	{
+		while (hash_cache.buckets[i])
+		{
+			struct hash_cache_entry *e = hash_cache.buckets[i];
+			hash_cache.buckets[i] = e->next;
+			free(e);
+		}
+	}
+	hash_cache.count = 0;
+	hash_cache.records = 0;
+}
+
+//rereads kdiff.cache when another session changed it since the last read
+void hash_cache_refresh(){
+	struct stat st;
+	if (hash_cache.bucket_count == 0)
+		hash_cache_init();
+	if (stat(kdiff_cache_path, &st) == -1)
+		return;
+	if (st.st_dev == hash_cache.file_dev && st.st_ino == hash_cache.file_ino && st.st_size == hash_cache.file_size)
+		return;
+	FILE *fp = fopen(kdiff_cache_path, "re");
+	if (fp == NULL)
+		return;
+	hash_cache_clear();
+	unsigned long long dev, ino, size, digest;
+	long long sec;
+	long nsec;
+	while (fscanf(fp, "%llu %llu %lld %ld %llu %llx\n", &dev, &ino, &sec, &nsec, &size, &digest) == 6)
+	{
+		hash_cache_put(dev, ino, (struct timespec){sec, nsec}, size, digest);
+		hash_cache.records++;
+	}
+	fclose(fp);
+	hash_cache.file_dev = st.st_dev;
+	hash_cache.file_ino = st.st_ino;
+	hash_cache.file_size = st.st_size;
+}
+
+//rewrites kdiff.cache with one line per file
+void hash_cache_compact(){
+	char tmp_path[520];
+	snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", kdiff_cache_path);
+	FILE *tmp = fopen(tmp_path, "we");
+	if (tmp == NULL)
+		return;
+	for (size_t i = 0; i < hash_cache.bucket_count; i++)
+		for (struct hash_cache_entry *e = hash_cache.buckets[i]; e; e = e->next)
+			fprintf(tmp, "%llu %llu %lld %ld %llu %016llx\n", (unsigned long long)e->dev, (unsigned long long)e->ino,
+					(long long)e->mtime.tv_sec, e->mtime.tv_nsec, (unsigned long long)e->size, (unsigned long long)e->digest);
+	fclose(tmp);
+	if (rename(tmp_path, kdiff_cache_path) == 0)
+	{
+		hash_cache.records = hash_cache.count;
+		hash_cache.file_size = -1; // reread on the next refresh
+	}
+}
+
+//appends one digest with a single write, the lock keeps lines of different sessions apart
+void hash_cache_append(const struct stat *st, uint64_t digest){
+	char line[128];
+	int len = snprintf(line, sizeof(line), "%llu %llu %lld %ld %llu %016llx\n", (unsigned long long)st->st_dev,
+					   (unsigned long long)st->st_ino, (long long)st->st_mtim.tv_sec, st->st_mtim.tv_nsec,
+					   (unsigned long long)st->st_size, (unsigned long long)digest);
+	int fd = open(kdiff_cache_path, O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0644);
+	if (fd == -1)
+		return;
+	flock(fd, LOCK_EX);
+	if (write(fd, line, len) == len)
+	{
+		struct stat cache_st;
+		fstat(fd, &cache_st);
+		// only skip our own line on the next refresh if nobody else wrote in between
+		if (cache_st.st_size == hash_cache.file_size + len && cache_st.st_ino == hash_cache.file_ino)
+			hash_cache.file_size = cache_st.st_size;
+		hash_cache.records++;
+	}
+	if (hash_cache.records > 2 * hash_cache.count + 64)
+		hash_cache_compact();
+	flock(fd, LOCK_UN);
+	close(fd);
+}
+
+//digest of an open file, taken from the cache when the file did not change since it was hashed
+int file_digest(int fd, const struct stat *st, uint64_t *digest){
+	struct hash_cache_entry *e = *hash_cache_link(st->st_dev, st->st_ino);
+	if (e && e->size == st->st_size && e->mtime.tv_sec == st->st_mtim.tv_sec && e->mtime.tv_nsec == st->st_mtim.tv_nsec)
+	{
+		*digest = e->digest;
+		return 0;
+	}
+	if (hash_fd(fd, digest) == -1)
+		return -1;
+	hash_cache_put(st->st_dev, st->st_ino, st->st_mtim, st->st_size, *digest);
+	// a file written during the last second may still change without moving its mtime
+	if (st->st_mtim.tv_sec < time(NULL) - 1)
+		hash_cache_append(st, *digest);
+	return 0;
+}
+
+//true when both are regular files with the same size and the same digest
+//anything else, including errors, is left to the real comparison
+bool kdiff_same_content(const char *file1_name, const char *file2_name){
+	struct stat st1, st2;
+	int fd1 = open(file1_name, O_RDONLY | O_CLOEXEC);
+	int fd2 = open(file2_name, O_RDONLY | O_CLOEXEC);
+	bool same = false;
+	if (fd1 != -1 && fd2 != -1 && fstat(fd1, &st1) == 0 && fstat(fd2, &st2) == 0 &&
+		S_ISREG(st1.st_mode) && S_ISREG(st2.st_mode) && st1.st_size == st2.st_size)
+	{
+		if (st1.st_dev == st2.st_dev && st1.st_ino == st2.st_ino)
+			same = true;
+		else
+		{
+			uint64_t digest1, digest2;
+			hash_cache_refresh();
+			same = file_digest(fd1, &st1, &digest1) == 0 && file_digest(fd2, &st2, &digest2) == 0 && digest1 == digest2;
+		}
+	}
+	if (fd1 != -1)
+		close(fd1);
+	if (fd2 != -1)
+		close(fd2);
+	return same;
+}
+// QUESTION 5 HELPER METHODS END //
+
+
+// QUESTION 6 HELPER METHOD START //
+
+// concatenate [-t] [-a] output input1 input2 ...
+// The inputs are copied one by one to the end of the output, with -t the output is truncated first.
+// The inputs are copied with copy_fd, while one input is copied the next one is
+// already being read ahead, and the throughput is reported at the end.
+// With -a the output is opened O_APPEND so the records of other writers of a live log stay
+// intact, the kernel then refuses copy_file_range() and sendfile() and read/write is used.
+void concatenate_txt_files(int argc, char *argv[]){
+	bool truncate = false, append = false;
+	for (; argc > 0 && (strcmp(argv[0], "-t") == 0 || strcmp(argv[0], "-a") == 0); argc--, argv++)
+	{
+		if (argv[0][1] == 't')
+			truncate = true;
+		else
+			append = true;
+	}
+	if(argc<2){
+		printf("Bad format there should be at least 2 arguments. %d is given\n", argc);
+		return;
+	}
+
+	int flags = O_WRONLY | O_CREAT | O_CLOEXEC | (truncate ? O_TRUNC : 0) | (append ? O_APPEND : 0);
+	int out_fd = open(argv[0], flags, 0644);
+	struct stat out_st;
+	// the copies continue from the end, copy_fd moves the offset of out_fd along
+	if (out_fd == -1 || fstat(out_fd, &out_st) == -1 || lseek(out_fd, 0, SEEK_END) == -1)
+	{
+		printf("-%s: concatenate: %s: %s\n", sysname, argv[0], strerror(errno));
+		if (out_fd != -1)
+			close(out_fd);
+		return;
+	}
+
+	struct timespec t0, t1;
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	int files = 0;
+	long long bytes = 0;
+	int next_fd = open(argv[1], O_RDONLY | O_CLOEXEC);
+	int next_errno = errno;
+	for (int i = 1; i < argc; i++)
+	{
+		int in_fd = next_fd;
+		errno = next_errno;
+		if (i + 1 < argc)
+		{
+			next_fd = open(argv[i + 1], O_RDONLY | O_CLOEXEC);
+			next_errno = errno;
+			if (next_fd != -1)
+				posix_fadvise(next_fd, 0, 0, POSIX_FADV_WILLNEED);
+		}
+		struct stat in_st;
+		if (in_fd == -1 || fstat(in_fd, &in_st) == -1)
+		{
+			printf("-%s: concatenate: %s: %s\n", sysname, argv[i], strerror(errno));
+			if (in_fd != -1)
+				close(in_fd);
+			continue;
+		}
+		if (in_st.st_dev == out_st.st_dev && in_st.st_ino == out_st.st_ino)
+		{
+			printf("-%s: concatenate: %s: input file is output file\n", sysname, argv[i]);
+			close(in_fd);
+			continue;
+		}
+		posix_fadvise(in_fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+		ssize_t copied = copy_fd(in_fd, out_fd);
+		if (copied == -1)
+			printf("-%s: concatenate: %s: %s\n", sysname, argv[i], strerror(errno));
+		else
+			files++, bytes += copied; // st_size means nothing for FIFOs and devices
+		close(in_fd);
+	}
+	close(out_fd);
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+
+	double seconds = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9;
+	printf("%lld bytes from %d files in %.3f s (%.1f MB/s)\n", bytes, files, seconds,
+		   seconds > 0 ? bytes / seconds / 1e6 : 0.0);
+}
+// QUESTION 6 HELPER METHOD END //
+
+
+// PIPELINE HELPER METHODS START //
+
+//runs every stage of a | b | c at the same time, connected by pipes
+//stage i reads from the pipe of stage i-1 and writes to the pipe of stage i+1
+int run_pipeline(struct command_t *command){
+	int in_fd = STDIN_FILENO;
+	int fds[2];
+	int stage_count = 0;
+	struct command_t *c;
+
+	for (c = command; c; c = c->next)
+		stage_count++;
+	pid_t *pids = malloc(sizeof(pid_t) * stage_count);
+	pid_t pgid = job_control ? 0 : -1; // the first stage leads the job's process group
+	struct timespec started;
+	clock_gettime(CLOCK_MONOTONIC, &started);
+
+	int i = 0;
+	for (c = command; c; c = c->next, i++)
+	{
+		int out_fd = STDOUT_FILENO;
+		if (c->next)
+		{
+			if (pipe2(fds, O_CLOEXEC) == -1)
+			{
+				printf("-%s: pipe: %s\n", sysname, strerror(errno));
+				break;
+			}
+			out_fd = fds[1];
+		}
+
+		// redirections override the pipe ends of this stage
+		int redirect_fds[2];
+		pids[i] = -1;
+		if (open_redirects(c, redirect_fds) == 0)
+		{
+			int stage_in = redirect_fds[0] != -1 ? redirect_fds[0] : in_fd;
+			int stage_out = redirect_fds[1] != -1 ? redirect_fds[1] : out_fd;
+			pids[i] = launch_stage(c, stage_in, stage_out, pgid);
+			if (pgid == 0 && pids[i] > 0)
+				pgid = pids[i];
+			for (int k = 0; k < 2; k++)
+				if (redirect_fds[k] != -1)
+					close(redirect_fds[k]);
+		}
+
+		if (in_fd != STDIN_FILENO)
+			close(in_fd);
+		if (out_fd != STDOUT_FILENO)
+			close(out_fd);
+		in_fd = c->next ? fds[0] : STDIN_FILENO;
+	}
+	if (in_fd != STDIN_FILENO)
+		close(in_fd);
+
+	struct job *job = job_create(command, pgid, pids, i);
+	free(pids);
+	if (job == NULL)
+	{
+		last_status = 127;
+		return SUCCESS;
+	}
+	job->started = started;
+	if (command->background)
+	{
+		if (job_control)
+			printf("[%d] %d\n", job->id, job->pgid);
+	}
+	else
+		wait_for_job(job, true); // waits for exactly the children of this pipeline
+	return SUCCESS;
+}
+
+//starts one stage with its stdin/stdout connected to in_fd/out_fd
+//external programs are started with posix_spawn and an argv prepared here in the parent,
+//fork is only used for stages that have to run shell code (builtins, splice stages)
+//returns the pid of the stage, -1 if it could not be started
+pid_t launch_stage(struct command_t *command, int in_fd, int out_fd, pid_t pgid){
+	pid_t pid;
+	if (helper_eligible(command) && (pid = helper_launch(command, in_fd, out_fd, pgid)) > 0)
+		return pid;
+	bool in_shell = command->subshell || is_builtin(command->name);
+	bool needs_fork = in_shell || zero_copy_eligible(command);
+
+	// the executable is looked up once in the parent, not after every fork
+	const char *exec_path = in_shell ? NULL : resolve_command(command->name);
+	if (exec_path == NULL && !needs_fork)
+	{
+		printf("-%s: %s: command not found\n", sysname, command->name);
+		return -1;
+	}
+
+	if (!needs_fork)
+	{
+		char **argv = build_argv(command);
+		pid = launch_argv(exec_path, argv, in_fd, out_fd, LAUNCH_SPAWN, pgid);
+		free(argv);
+		return pid;
+	}
+
+	fflush(stdout); // do not let the child inherit pending output
+	pid = fork();
+	if (pid == 0)
+	{
+		if (pgid != -1)
+			setpgid(0, pgid);
+		reset_child_signals();
+		helper_pool_detach();
+		// dup2 clears O_CLOEXEC on the target, every other fd is closed on exec
+		if (in_fd != STDIN_FILENO)
+			dup2(in_fd, STDIN_FILENO);
+		if (out_fd != STDOUT_FILENO)
+			dup2(out_fd, STDOUT_FILENO);
+		exec_stage(command, exec_path);
+	}
+	if (pid == -1)
+		printf("-%s: fork: %s\n", sysname, strerror(errno));
+	else if (pgid != -1)
+		setpgid(pid, pgid ? pgid : pid); // also set in the parent so there is no race with tcsetpgrp
+	return pid;
+}
+
+//argv for execv: the command name followed by the arguments and a NULL
+//the strings are shared with the command, only the array has to be freed
+char **build_argv(struct command_t *command){
+	char **argv = malloc(sizeof(char *) * (command->arg_count + 2));
+	argv[0] = command->name;
+	for (int i = 0; i < command->arg_count; i++)
+		argv[i + 1] = command->args[i];
+	argv[command->arg_count + 1] = NULL;
+	return argv;
+}
+
+//starts path with the given strategy, in_fd/out_fd become stdin/stdout of the child
+//pgid is the process group to join, 0 to lead a new one, -1 to stay in the shell's group
+//returns the pid of the child, -1 after printing the error if it could not be started
+pid_t launch_argv(const char *path, char **argv, int in_fd, int out_fd, int strategy, pid_t pgid){
+	pid_t pid;
+
+	if (strategy == LAUNCH_SPAWN)
+	{
+		posix_spawn_file_actions_t actions;
+		posix_spawn_file_actions_init(&actions);
+		if (in_fd != STDIN_FILENO)
+			posix_spawn_file_actions_adddup2(&actions, in_fd, STDIN_FILENO);
+		if (out_fd != STDOUT_FILENO)
+			posix_spawn_file_actions_adddup2(&actions, out_fd, STDOUT_FILENO);
+
+		// the shell ignores the job control signals, the child gets the defaults back
+		posix_spawnattr_t attr;
+		sigset_t default_signals;
+		posix_spawnattr_init(&attr);
+		sigemptyset(&default_signals);
+		sigaddset(&default_signals, SIGINT);
+		sigaddset(&default_signals, SIGQUIT);
+		sigaddset(&default_signals, SIGTSTP);
+		sigaddset(&default_signals, SIGTTIN);
+		sigaddset(&default_signals, SIGTTOU);
+		sigaddset(&default_signals, SIGCHLD);
+		posix_spawnattr_setsigdefault(&attr, &default_signals);
+		short flags = POSIX_SPAWN_SETSIGDEF;
+		if (pgid != -1)
+		{
+			posix_spawnattr_setpgroup(&attr, pgid);
+			flags |= POSIX_SPAWN_SETPGROUP;
+		}
+		posix_spawnattr_setflags(&attr, flags);
+
+		fflush(stdout);
+		int r = posix_spawn(&pid, path, &actions, &attr, argv, environ);
+		posix_spawn_file_actions_destroy(&actions);
+		posix_spawnattr_destroy(&attr);
+		if (r != 0)
+		{
+			printf("-%s: %s: %s\n", sysname, argv[0], strerror(r));
+			return -1;
+		}
+		if (pgid != -1)
+			setpgid(pid, pgid ? pgid : pid);
+		return pid;
+	}
+
+	// read after vfork returns, so it must not live in a register the child may reuse
+	volatile pid_t group = pgid;
+	fflush(stdout);
+	pid = strategy == LAUNCH_VFORK ? vfork() : fork();
+	if (pid == 0)
+	{
+		// only async-signal-safe calls here, the vfork child shares our memory
+		if (group != -1)
+			setpgid(0, group);
+		reset_child_signals();
+		if (in_fd != STDIN_FILENO)
+			dup2(in_fd, STDIN_FILENO);
+		if (out_fd != STDOUT_FILENO)
+			dup2(out_fd, STDOUT_FILENO);
+		execv(path, argv);
+		_exit(127);
+	}
+	if (pid == -1)
+		printf("-%s: fork: %s\n", sysname, strerror(errno));
+	else if (group != -1)
+		setpgid(pid, group ? group : pid);
+	return pid;
+}
+
+//launches a trivial command count times with every strategy and reports launches/second
+void spawn_benchmark(int count, char **argv){
+	static const char *names[] = {"fork+exec", "vfork+exec", "posix_spawn"};
+	static const int strategies[] = {LAUNCH_FORK, LAUNCH_VFORK, LAUNCH_SPAWN};
+
+	const char *path = resolve_command(argv[0]);
+	if (path == NULL)
+	{
+		printf("-%s: %s: command not found\n", sysname, argv[0]);
+		return;
+	}
+	int null_fd = open("/dev/null", O_WRONLY | O_CLOEXEC);
+
+	for (int s = 0; s < 3; s++)
+	{
+		struct timespec start, end;
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		for (int i = 0; i < count; i++)
+		{
+			pid_t pid = launch_argv(path, argv, STDIN_FILENO, null_fd, strategies[s], -1);
+			if (pid == -1)
+				break;
+			waitpid(pid, NULL, 0);
+		}
+		clock_gettime(CLOCK_MONOTONIC, &end);
+		double seconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+		printf("%-12s %8d launches in %.3fs: %10.1f launches/s\n", names[s], count, seconds, count / seconds);
+	}
+	close(null_fd);
+}
+
+//runs one stage inside the forked child and never returns
+//exec_path is the resolved executable, NULL if it was not found in $PATH
+void exec_stage(struct command_t *command, const char *exec_path){
+	// ( list ) is run by this forked shell, without job control
+	if (command->subshell)
+	{
+		// SIGCHLD is back to the default here and the pipe is the parent's
+		close(sigchld_pipe[0]);
+		close(sigchld_pipe[1]);
+		sigchld_init();
+		job_control = false;
+		last_status = 0;
+		process_command(command->subshell);
+		fflush(stdout);
+		_exit(last_status);
+	}
+	last_status = 0;
+	if (run_builtin(command) != NOT_BUILTIN)
+	{
+		fflush(stdout);
+		_exit(last_status);
+	}
+	if (try_zero_copy_stage(command))
+		_exit(last_status); // 1 when an input could not be opened or copied
+
+	char **argv = build_argv(command);
+
+	//---------------QUESTION 1---------------//
+	if (exec_path)
+		execv(exec_path, argv);
+
+	printf("-%s: %s: command not found\n", sysname, command->name);
+	fflush(stdout);
+	_exit(127);
+}
+
+//cat and tee stages without options only move bytes and can be served in the shell
+bool zero_copy_eligible(struct command_t *command){
+	if (strcmp(command->name, "cat") != 0 && strcmp(command->name, "tee") != 0)
+		return false;
+	for (int i = 0; i < command->arg_count; i++)
+		if (command->args[i][0] == '-')
+			return false; // options are left to the real program
+	return true;
+}
+
+//cat and tee stages only move bytes, so they are served with splice()/tee()
+//instead of exec'ing a program that copies through user space
+//returns false when the stage has to be exec'd normally, failures set last_status to 1
+bool try_zero_copy_stage(struct command_t *command){
+	int i;
+	if (!zero_copy_eligible(command))
+		return false;
+
+	if (strcmp(command->name, "cat") == 0)
+	{
+		if (command->arg_count == 0)
+			return copy_fd(STDIN_FILENO, STDOUT_FILENO) != -1;
+		for (i = 0; i < command->arg_count; i++)
+		{
+			int fd = open(command->args[i], O_RDONLY | O_CLOEXEC);
+			if (fd == -1)
+			{
+				fprintf(stderr, "cat: %s: %s\n", command->args[i], strerror(errno));
+				last_status = 1; // like coreutils cat, the other inputs are still copied
+				continue;
+			}
+			if (copy_fd(fd, STDOUT_FILENO) == -1)
+				last_status = 1;
+			close(fd);
+		}
+		return true;
+	}
+
+	if (strcmp(command->name, "tee") == 0 && command->arg_count == 1)
+	{
+		struct stat in_st, out_st;
+		if (fstat(STDIN_FILENO, &in_st) == -1 || fstat(STDOUT_FILENO, &out_st) == -1 ||
+			!S_ISFIFO(in_st.st_mode) || !S_ISFIFO(out_st.st_mode))
+			return false; // tee() needs a pipe on both sides
+
+		int fd = open(command->args[0], O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+		if (fd == -1)
+		{
+			fprintf(stderr, "tee: %s: %s\n", command->args[0], strerror(errno));
+			last_status = 1;
+			return copy_fd(STDIN_FILENO, STDOUT_FILENO) != -1;
+		}
+		while (1)
+		{
+			// duplicate the pipe contents to stdout, then drain the same bytes into the file
+			ssize_t n = tee(STDIN_FILENO, STDOUT_FILENO, 1 << 20, 0);
+			if (n == 0)
+				break;
+			if (n == -1)
+			{
+				if (errno == EINTR)
+					continue;
+				break;
+			}
+			while (n > 0)
+			{
+				ssize_t m = splice(STDIN_FILENO, NULL, fd, NULL, n, SPLICE_F_MOVE);
+				if (m == -1 && errno == EINTR)
+					continue;
+				if (m <= 0)
+				{
+					if (m == 0)
+						errno = EIO;
+					break;
+				}
+				n -= m;
+			}
+			if (n == 0)
+				continue;
+
+			// the file failed, the bytes already teed to stdout must still leave the pipe
+			// or the next tee() would copy them again
+			fprintf(stderr, "tee: %s: %s\n", command->args[0], strerror(errno));
+			last_status = 1;
+			char buf[65536];
+			while (n > 0)
+			{
+				ssize_t m = read(STDIN_FILENO, buf, n < (ssize_t)sizeof(buf) ? n : (ssize_t)sizeof(buf));
+				if (m == -1 && errno == EINTR)
+					continue;
+				if (m <= 0)
+					break;
+				n -= m;
+			}
+			close(fd);
+			return copy_fd(STDIN_FILENO, STDOUT_FILENO) != -1;
+		}
+		close(fd);
+		return true;
+	}
+	return false;
+}
+
+//moves everything from in_fd to out_fd without a user space copy when possible
+//file to file uses copy_file_range(), file to anything uses sendfile(),
+//splice() is used when one of the ends is a pipe, read/write otherwise
+//returns the number of bytes copied, -1 on error
+ssize_t copy_fd(int in_fd, int out_fd){
+	struct stat in_st, out_st;
+	ssize_t n;
+	bool in_reg = fstat(in_fd, &in_st) == 0 && S_ISREG(in_st.st_mode);
+	bool out_reg = fstat(out_fd, &out_st) == 0 && S_ISREG(out_st.st_mode);
+	size_t copied = 0;
+
+	if (in_reg && out_reg)
+	{
+		while ((n = copy_file_range(in_fd, NULL, out_fd, NULL, 1 << 30, 0)) > 0)
+			copied += n;
+		if (n == 0)
+			return copied;
+		if (copied > 0)
+			return -1;
+		// EXDEV on old kernels, EBADF for O_APPEND outputs: try the next method
+	}
+	if (in_reg)
+	{
+		while ((n = sendfile(out_fd, in_fd, NULL, 1 << 30)) > 0)
+			copied += n;
+		if (n == 0)
+			return copied;
+		if (copied > 0)
+			return -1;
+	}
+
+	while ((n = splice(in_fd, NULL, out_fd, NULL, 1 << 20, SPLICE_F_MOVE | SPLICE_F_MORE)) > 0)
+		copied += n;
+	if (n == 0)
+		return copied;
+	if (copied > 0 || (errno != EINVAL && errno != ENOSYS))
+		return -1;
+
+	// neither end is a pipe or the file system does not support splice
+	char buf[65536];
+	while ((n = read(in_fd, buf, sizeof(buf))) != 0)
+	{
+		if (n == -1)
+		{
+			if (errno == EINTR)
+				continue;
+			return -1;
+		}
+		if (write_all(out_fd, buf, n) == -1)
+			return -1;
+		copied += n;
+	}
+	return copied;
+}
+
+//writes len bytes, retrying short writes, returns -1 on error
+int write_all(int fd, const char *buf, size_t len){
+	while (len > 0)
+	{
+		ssize_t w = write(fd, buf, len);
+		if (w == -1)
+		{
+			if (errno == EINTR)
+				continue;
+			return -1;
+		}
+		buf += w;
+		len -= w;
+	}
+	return 0;
+}
+
+//opens the < and > / >> targets of a command with O_CLOEXEC
+//redirect_fds[0] is the new stdin and redirect_fds[1] the new stdout, -1 if not redirected
+//returns -1 after printing the error if a file can not be opened
+int open_redirects(struct command_t *command, int redirect_fds[2]){
+	redirect_fds[0] = redirect_fds[1] = -1;
+
+	if (command->redirects[0])
+	{
+		redirect_fds[0] = open(command->redirects[0], O_RDONLY | O_CLOEXEC);
+		if (redirect_fds[0] == -1)
+		{
+			printf("-%s: %s: %s\n", sysname, command->redirects[0], strerror(errno));
+			return -1;
+		}
+	}
+	// > truncates, >> appends
+	for (int i = 1; i <= 2; i++)
+	{
+		if (!command->redirects[i])
+			continue;
+		if (redirect_fds[1] != -1)
+			close(redirect_fds[1]);
+		int flags = O_WRONLY | O_CREAT | O_CLOEXEC | (i == 1 ? O_TRUNC : O_APPEND);
+		redirect_fds[1] = open(command->redirects[i], flags, 0644);
+		if (redirect_fds[1] == -1)
+		{
+			printf("-%s: %s: %s\n", sysname, command->redirects[i], strerror(errno));
+			if (redirect_fds[0] != -1)
+				close(redirect_fds[0]);
+			redirect_fds[0] = -1;
+			return -1;
+		}
+	}
+	return 0;
+}
+
+//runs a builtin in the shell process with its stdin/stdout pointed at the redirect targets
+//the builtin writes straight into the target fd, the shell's own fds are restored afterwards
+int run_builtin_redirected(struct command_t *command, int redirect_fds[2]){
+	int saved[2] = {-1, -1};
+
+	fflush(stdout);
+	for (int i = 0; i < 2; i++)
+	{
+		if (redirect_fds[i] == -1)
+			continue;
+		saved[i] = fcntl(i, F_DUPFD_CLOEXEC, 10);
+		dup2(redirect_fds[i], i);
+		close(redirect_fds[i]);
+	}
+
+	int r = run_builtin(command);
+
+	fflush(stdout);
+	for (int i = 0; i < 2; i++)
+	{
+		if (saved[i] == -1)
+			continue;
+		dup2(saved[i], i);
+		close(saved[i]);
+	}
+	if (saved[0] != -1)
+		clearerr(stdin);
+	return r;
+}
+// PIPELINE HELPER METHODS END //
+
+
+// PATH LOOKUP HELPER METHODS START //
+
+//resolved executables are kept in a hash table like bash's hash builtin
+//an entry remembers which $PATH directory it came from, a change in the mtime of
+//that directory or of any directory before it makes the entry stale
+//entries added with hash -p have no directory and stay until hash -r or a new $PATH
+#define PATH_HASH_SIZE 256
+
+struct path_entry
+{
+	char *name;
+	char *path;
+	int dir_index;
+	int hits;
+	struct path_entry *next;
+};
+
+struct path_entry *path_table[PATH_HASH_SIZE];
+char *path_env;			   // copy of $PATH the directory list was built from
+char **path_dirs;
+struct timespec *path_dir_mtimes;
+int path_dir_count;
+time_t path_checked;	   // directory mtimes are checked at most once a second
+
+//FNV-1a hash of a string
+unsigned int hash_string(const char *str){
+	unsigned int h = 2166136261u;
+	while (*str)
+	{
+		h ^= (unsigned char)*str++;
+		h *= 16777619u;
+	}
+	return h;
+}
+
+//drops every cached entry that came from directory first_dir or a later one
+void path_hash_drop(int first_dir){
+	for (int i = 0; i < PATH_HASH_SIZE; i++)
+	{
+		struct path_entry **link = &path_table[i];
+		while (*link)
+		{
+			struct path_entry *e = *link;
+			if (e->dir_index >= first_dir)
+			{
+				*link = e->next;
+				free(e->name);
+				free(e->path);
+				free(e);
+			}
+			else
+				link = &e->next;
+		}
+	}
+}
+
+//forgets all remembered locations, used by hash -r
+void path_hash_clear(){
+	path_hash_drop(-1);
+}
+
+//remembers path as the location of name, used by hash -p
+void path_hash_set(const char *path, const char *name){
+	path_dirs_refresh();
+	unsigned int bucket = hash_string(name) % PATH_HASH_SIZE;
+	struct path_entry **link = &path_table[bucket];
+	while (*link && strcmp((*link)->name, name) != 0)
+		link = &(*link)->next;
+	struct path_entry *e = *link;
+	if (e == NULL)
+	{
+		e = calloc(1, sizeof(struct path_entry));
+		e->name = strdup(name);
+		*link = e;
+	}
+	else
+		free(e->path);
+	e->path = strdup(path);
+	e->dir_index = -1;
+}
+
+//rebuilds the directory list when $PATH changes and invalidates
+//entries whose directories were modified since they were cached
+void path_dirs_refresh(){
+	const char *env = getenv("PATH");
+	if (env == NULL)
+		env = "/usr/local/bin:/usr/bin:/bin";
+
+	if (path_env == NULL || strcmp(path_env, env) != 0)
+	{
+		for (int i = 0; i < path_dir_count; i++)
+			free(path_dirs[i]);
+		free(path_dirs);
+		free(path_dir_mtimes);
+		free(path_env);
+		path_hash_clear();
+
+		path_env = strdup(env);
+		path_dir_count = 1;
+		for (const char *p = env; *p; p++)
+			if (*p == ':')
+				path_dir_count++;
+		path_dirs = malloc(sizeof(char *) * path_dir_count);
+		path_dir_mtimes = calloc(path_dir_count, sizeof(struct timespec));
+
+		const char *start = env;
+		for (int i = 0; i < path_dir_count; i++)
+		{
+			const char *end = strchr(start, ':');
+			size_t len = end ? (size_t)(end - start) : strlen(start);
+			path_dirs[i] = len ? strndup(start, len) : strdup("."); // empty entry means cwd
+			start = end ? end + 1 : start + len;
+		}
+		path_checked = 0;
+	}
+
+	time_t now = time(NULL);
+	if (now == path_checked)
+		return;
+	path_checked = now;
+
+	for (int i = 0; i < path_dir_count; i++)
+	{
+		struct stat st;
+		struct timespec mtime = {0, 0};
+		if (stat(path_dirs[i], &st) == 0)
+			mtime = st.st_mtim;
+		if (mtime.tv_sec != path_dir_mtimes[i].tv_sec || mtime.tv_nsec != path_dir_mtimes[i].tv_nsec)
+		{
+			path_hash_drop(i);
+			path_dir_mtimes[i] = mtime;
+		}
+	}
+}
+
+//returns the full path of an executable, searching $PATH through the cache
+//names containing a slash are used as they are, NULL if nothing is found
+const char *resolve_command(const char *name){
+	if (strchr(name, '/'))
+		return name;
+
+	path_dirs_refresh();
+	unsigned int bucket = hash_string(name) % PATH_HASH_SIZE;
+	for (struct path_entry *e = path_table[bucket]; e; e = e->next)
+	{
+		if (strcmp(e->name, name) == 0)
+		{
+			e->hits++;
+			return e->path;
+		}
+	}
+
+	size_t name_len = strlen(name);
+	for (int i = 0; i < path_dir_count; i++)
+	{
+		size_t dir_len = strlen(path_dirs[i]);
+		char *candidate = malloc(dir_len + name_len + 2);
+		memcpy(candidate, path_dirs[i], dir_len);
+		candidate[dir_len] = '/';
+		memcpy(candidate + dir_len + 1, name, name_len + 1);
+
+		struct stat st;
+		if (stat(candidate, &st) == 0 && S_ISREG(st.st_mode) && access(candidate, X_OK) == 0)
+		{
+			struct path_entry *e = malloc(sizeof(struct path_entry));
+			e->name = strdup(name);
+			e->path = candidate;
+			e->dir_index = i;
+			e->hits = 1;
+			e->next = path_table[bucket];
+			path_table[bucket] = e;
+			return e->path;
+		}
+		free(candidate);
+	}
+	return NULL;
+}
+
+//prints the remembered locations, in a form that can be reused with -l
+void path_hash_list(bool reusable){
+	bool empty = true;
+	for (int i = 0; i < PATH_HASH_SIZE; i++)
+	{
+		for (struct path_entry *e = path_table[i]; e; e = e->next)
+		{
+			if (empty && !reusable)
+				printf("hits\tcommand\n");
+			empty = false;
+			if (reusable)
+				printf("hash -p %s %s\n", e->path, e->name);
+			else
+				printf("%4d\t%s\n", e->hits, e->path);
+		}
+	}
+	if (empty)
+		printf("hash table empty\n");
+}
+// PATH LOOKUP HELPER METHODS END //
+
+
+// JOB CONTROL HELPER METHODS START //
+
+//every pipeline is a job keyed by its process group
+//children are reaped from SIGCHLD through a self-pipe, so background jobs never pile up as zombies
+void sigchld_handler(int sig){
+	(void)sig;
+	int saved_errno = errno;
+	write(sigchld_pipe[1], "", 1); // non-blocking, a full pipe already means "reap"
+	errno = saved_errno;
+}
+
+//installs the SIGCHLD self-pipe, a forked subshell calls it again for its own children
+void sigchld_init(){
+	pipe2(sigchld_pipe, O_CLOEXEC | O_NONBLOCK);
+
+	struct sigaction sa;
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = sigchld_handler;
+	sa.sa_flags = SA_RESTART;
+	sigemptyset(&sa.sa_mask);
+	sigaction(SIGCHLD, &sa, NULL);
+}
+
+//installs the SIGCHLD self-pipe and takes over the terminal when interactive
+void job_control_init(){
+	sigchld_init();
+
+	job_control = isatty(STDIN_FILENO);
+	if (!job_control)
+		return;
+	// the foreground job gets ^C/^Z, the shell must not stop when it takes the terminal back
+	signal(SIGINT, SIG_IGN);
+	signal(SIGQUIT, SIG_IGN);
+	signal(SIGTSTP, SIG_IGN);
+	signal(SIGTTIN, SIG_IGN);
+	signal(SIGTTOU, SIG_IGN);
+	shell_pgid = getpid();
+	if (getpgrp() != shell_pgid)
+		setpgid(0, shell_pgid);
+	tcsetpgrp(STDIN_FILENO, shell_pgid);
+}
+
+//restores the signals the shell ignores, called in children before exec
+void reset_child_signals(){
+	signal(SIGINT, SIG_DFL);
+	signal(SIGQUIT, SIG_DFL);
+	signal(SIGTSTP, SIG_DFL);
+	signal(SIGTTIN, SIG_DFL);
+	signal(SIGTTOU, SIG_DFL);
+	signal(SIGCHLD, SIG_DFL);
+}
+
+//appends a pipeline, and with list the pipelines after it, the way they were typed
+void command_text_append(struct outbuf *text, struct command_t *command, bool list){
+	static const char *redirect_ops[] = {" <", " >", " >>"};
+	static const char *list_ops[] = {"; ", " && ", " || "};
+	for (struct command_t *pipeline = command; pipeline; pipeline = list ? pipeline->list_next : NULL)
+	{
+		for (struct command_t *c = pipeline; c; c = c->next)
+		{
+			if (c->subshell)
+			{
+				outbuf_put(text, "(", 1);
+				command_text_append(text, c->subshell, true);
+				outbuf_put(text, ")", 1);
+			}
+			else
+				outbuf_put(text, c->name, strlen(c->name));
+			for (int i = 0; i < c->arg_count; i++)
+			{
+				outbuf_put(text, " ", 1);
+				outbuf_put(text, c->args[i], strlen(c->args[i]));
+			}
+			for (int i = 0; i < 3; i++)
+			{
+				if (!c->redirects[i])
+					continue;
+				outbuf_put(text, redirect_ops[i], strlen(redirect_ops[i]));
+				outbuf_put(text, c->redirects[i], strlen(c->redirects[i]));
+			}
+			if (c->next)
+				outbuf_put(text, " | ", 3);
+		}
+		if (list && pipeline->background)
+			outbuf_put(text, " &", 2);
+		if (list && pipeline->list_next)
+		{
+			const char *op = pipeline->background ? " " : list_ops[pipeline->list_op];
+			outbuf_put(text, op, strlen(op));
+		}
+	}
+}
+
+//the command line of a job as it is shown by jobs
+char *command_to_text(struct command_t *command){
+	struct outbuf text = {.data = malloc(64), .cap = 64, .fd = -1};
+	command_text_append(&text, command, false);
+	outbuf_put(&text, "", 1);
+	return text.data;
+}
+
+//adds the started processes of a pipeline to the job table
+//returns NULL if no process could be started
+struct job *job_create(struct command_t *command, pid_t pgid, pid_t *pids, int count){
+	int started = 0;
+	for (int i = 0; i < count; i++)
+		if (pids[i] > 0)
+			started++;
+	if (started == 0)
+		return NULL;
+
+	struct job *job = calloc(1, sizeof(struct job));
+	job->procs = calloc(started, sizeof(struct job_process));
+	for (int i = 0; i < count; i++)
+		if (pids[i] > 0)
+		{
+			job->procs[job->proc_count].helper = helper_is_busy(pids[i]);
+			job->procs[job->proc_count++].pid = pids[i];
+		}
+	job->pgid = pgid > 0 ? pgid : job->procs[0].pid;
+	job->text = command_to_text(command);
+	job->background = command->background;
+
+	// smallest free job number, the list is kept sorted by id
+	struct job **link = &job_list;
+	job->id = 1;
+	while (*link && (*link)->id == job->id)
+	{
+		job->id++;
+		link = &(*link)->next;
+	}
+	job->next = *link;
+	*link = job;
+	return job;
+}
+
+void job_remove(struct job *job){
+	if (job_is_done(job))
+		stats_record(job->text, &job->started, &job->usage, job_exit_status(job));
+	for (struct job **link = &job_list; *link; link = &(*link)->next)
+	{
+		if (*link == job)
+		{
+			*link = job->next;
+			break;
+		}
+	}
+	free(job->procs);
+	free(job->text);
+	free(job);
+}
+
+bool job_is_done(struct job *job){
+	for (int i = 0; i < job->proc_count; i++)
+		if (!job->procs[i].done)
+			return false;
+	return true;
+}
+
+bool job_is_stopped(struct job *job){
+	for (int i = 0; i < job->proc_count; i++)
+		if (!job->procs[i].done && !job->procs[i].stopped)
+			return false;
+	return !job_is_done(job);
+}
+
+//exit status of a job is the status of its last stage, 128+n when killed by signal n
+int job_exit_status(struct job *job){
+	int status = job->procs[job->proc_count - 1].status;
+	if (WIFSIGNALED(status))
+		return 128 + WTERMSIG(status);
+	return WEXITSTATUS(status);
+}
+
+void rusage_add(struct rusage *total, struct rusage *ru){
+	timeradd(&total->ru_utime, &ru->ru_utime, &total->ru_utime);
+	timeradd(&total->ru_stime, &ru->ru_stime, &total->ru_stime);
+	if (ru->ru_maxrss > total->ru_maxrss)
+		total->ru_maxrss = ru->ru_maxrss;
+	total->ru_inblock += ru->ru_inblock;
+	total->ru_oublock += ru->ru_oublock;
+	total->ru_nvcsw += ru->ru_nvcsw;
+	total->ru_nivcsw += ru->ru_nivcsw;
+}
+
+//records a status change reported by wait4 in the job the process belongs to
+void job_update(pid_t pid, int status, struct rusage *ru){
+	for (struct job *job = job_list; job; job = job->next)
+	{
+		for (int i = 0; i < job->proc_count; i++)
+		{
+			struct job_process *p = &job->procs[i];
+			if (p->pid != pid || p->done)
+				continue; // a helper shows up again in every job it served
+			if (WIFSTOPPED(status))
+				p->stopped = true;
+			else if (WIFCONTINUED(status))
+				p->stopped = false;
+			else
+			{
+				p->done = true;
+				p->status = status;
+				rusage_add(&job->usage, ru);
+			}
+			return;
+		}
+	}
+}
+
+//reaps the processes of jobs that changed state, never blocks
+//only the pids in the job table are waited for, other children such as the git of the
+//prompt worker are left to whoever started them
+void reap_children(){
+	char drain[64];
+	pid_t pid;
+	int status;
+	struct rusage ru;
+	while ((pid = helper_reap(&status, &ru)) > 0)
+		job_update(pid, status, &ru);
+	while (read(sigchld_pipe[0], drain, sizeof(drain)) > 0)
+		; // the SIGCHLD that woke us, the table below is checked anyway
+
+	for (struct job *job = job_list; job; job = job->next)
+		for (int i = 0; i < job->proc_count; i++)
+			while (!job->procs[i].done &&
+				   (pid = wait4(job->procs[i].pid, &status, WNOHANG | WUNTRACED | WCONTINUED, &ru)) > 0)
+				job_update(pid, status, &ru);
+	helper_reap_retired();
+}
+
+//set by ^C while the wait builtin blocks, see job_builtin
+volatile sig_atomic_t wait_interrupted = 0;
+
+void wait_interrupt_handler(int sig){
+	(void)sig;
+	wait_interrupted = 1;
+}
+
+//blocks until the job finishes or is stopped
+//a foreground job gets the terminal meanwhile, a background one keeps running without it
+//and the wait ends early on ^C, leaving the job in the list
+void wait_for_job(struct job *job, bool foreground){
+	if (job_control && foreground)
+		tcsetpgrp(STDIN_FILENO, job->pgid);
+
+	// stages end with SIGCHLD, helpers answer on their sockets
+	// background jobs finishing meanwhile are recorded too
+	reap_children();
+	while (!job_is_done(job) && !job_is_stopped(job) && !(!foreground && wait_interrupted))
+	{
+		struct pollfd fds[helper_count() + 1];
+		fds[0] = (struct pollfd){.fd = sigchld_pipe[0], .events = POLLIN};
+		int nfds = 1 + helper_poll_fds(fds + 1);
+		if (poll(fds, nfds, -1) == -1 && errno != EINTR)
+			break;
+		reap_children();
+	}
+
+	if (job_control && foreground)
+		tcsetpgrp(STDIN_FILENO, shell_pgid);
+
+	if (!foreground && wait_interrupted && !job_is_done(job) && !job_is_stopped(job))
+	{
+		last_status = 128 + SIGINT; // interrupted wait, the job keeps running
+		printf("\n");
+		return;
+	}
+	if (job_is_stopped(job))
+	{
+		job->background = true;
+		last_status = 128 + SIGTSTP;
+		printf("\n[%d]+  Stopped\t\t%s\n", job->id, job->text);
+		return;
+	}
+	last_status = job_exit_status(job);
+	if (last_status == 128 + SIGINT && foreground)
+		printf("\n"); // ^C leaves the cursor after the echoed control character
+	job_remove(job);
+}
+
+//reports background jobs that finished since the last prompt and forgets them
+//scripts forget them silently
+void notify_jobs(){
+	reap_children();
+	struct job *job = job_list;
+	while (job)
+	{
+		struct job *next = job->next;
+		if (job_is_done(job) && !job_control)
+			job_remove(job);
+		else if (job_is_done(job))
+		{
+			int status = job_exit_status(job);
+			if (status == 0)
+				printf("[%d]+  Done\t\t\t%s\n", job->id, job->text);
+			else
+				printf("[%d]+  Exit %d\t\t%s\n", job->id, status, job->text);
+			job_remove(job);
+		}
+		job = next;
+	}
+}
+
+void list_jobs(){
+	reap_children();
+	for (struct job *job = job_list; job; job = job->next)
+	{
+		const char *state = job_is_done(job) ? "Done" : job_is_stopped(job) ? "Stopped" : "Running";
+		printf("[%d]  %-8s %d\t%s  (user %ld.%03lds sys %ld.%03lds)\n", job->id, state, job->pgid, job->text,
+			   (long)job->usage.ru_utime.tv_sec, (long)job->usage.ru_utime.tv_usec / 1000,
+			   (long)job->usage.ru_stime.tv_sec, (long)job->usage.ru_stime.tv_usec / 1000);
+	}
+}
+
+//%n or n selects job n, a bare pid selects the job with that process group
+//NULL spec selects the most recent job
+struct job *find_job(const char *spec){
+	struct job *job;
+	if (spec == NULL)
+	{
+		struct job *last = NULL;
+		for (job = job_list; job; job = job->next)
+			if (last == NULL || job->id > last->id)
+				last = job;
+		return last;
+	}
+	int n = atoi(spec[0] == '%' ? spec + 1 : spec);
+	for (job = job_list; job; job = job->next)
+		if (job->id == n || job->pgid == n)
+			return job;
+	return NULL;
+}
+
+//jobs, fg, bg and wait
+int job_builtin(struct command_t *command){
+	if (strcmp(command->name, "jobs") == 0)
+	{
+		list_jobs();
+		return SUCCESS;
+	}
+
+	if (strcmp(command->name, "wait") == 0)
+	{
+		// the jobs stay in the background, the shell keeps the terminal and ^C
+		// only interrupts the wait, like in bash
+		struct sigaction sa, old_sa;
+		memset(&sa, 0, sizeof(sa));
+		sa.sa_handler = wait_interrupt_handler;
+		sigemptyset(&sa.sa_mask);
+		wait_interrupted = 0;
+		if (job_control)
+			sigaction(SIGINT, &sa, &old_sa);
+
+		// without arguments wait for every job, otherwise only the given ones
+		if (command->arg_count == 0)
+		{
+			reap_children();
+			while (job_list)
+			{
+				struct job *job = job_list;
+				wait_for_job(job, false);
+				if (job_list == job) // stopped or interrupted, do not wait forever
+					break;
+			}
+		}
+		for (int i = 0; i < command->arg_count && !wait_interrupted; i++)
+		{
+			struct job *job = find_job(command->args[i]);
+			if (job == NULL)
+			{
+				printf("-%s: wait: %s: no such job\n", sysname, command->args[i]);
+				last_status = 127;
+				continue;
+			}
+			wait_for_job(job, false);
+		}
+		if (job_control)
+			sigaction(SIGINT, &old_sa, NULL);
+		return SUCCESS;
+	}
+
+	struct job *job = find_job(command->arg_count > 0 ? command->args[0] : NULL);
+	if (job == NULL)
+	{
+		printf("-%s: %s: no such job\n", sysname, command->name);
+		last_status = 1;
+		return SUCCESS;
+	}
+	for (int i = 0; i < job->proc_count; i++)
+		job->procs[i].stopped = false;
+	kill(-job->pgid, SIGCONT);
+
+	if (strcmp(command->name, "bg") == 0)
+	{
+		job->background = true;
+		printf("[%d]+ %s &\n", job->id, job->text);
+		return SUCCESS;
+	}
+	job->background = false;
+	printf("%s\n", job->text);
+	wait_for_job(job, true);
+	return SUCCESS;
+}
+// JOB CONTROL HELPER METHODS END //
+
+
+// BATCH MODE HELPER METHODS START //
+
+//runs one line of a script, comment lines starting with # are skipped
+//returns EXIT when the script asked to exit
+int run_batch_line(char *line){
+	char *p = line;
+	while (*p == ' ' || *p == '\t')
+		p++;
+	if (*p == 0 || *p == '#')
+		return SUCCESS;
+
+	notify_jobs();
+	struct command_t *command = calloc(1, sizeof(struct command_t));
+	parse_command(p, command);
+	int code = process_command(command);
+	free_command(command);
+	return code;
+}
+
+//runs every line of a buffer holding a whole script, lines are split with memchr
+//the buffer is modified in place, returns the exit status of the last command
+int run_batch_buffer(char *buf, size_t len){
+	char *end = buf + len;
+	while (buf < end)
+	{
+		char *nl = memchr(buf, '\n', end - buf);
+		char *line_end = nl ? nl : end;
+		char saved = *line_end;
+		*line_end = 0; // for the last line this is the string terminator already
+		int code = run_batch_line(buf);
+		if (nl == NULL)
+			*line_end = saved;
+		if (code == EXIT)
+			break;
+		buf = line_end + 1;
+	}
+	fflush(stdout);
+	return last_status;
+}
+
+//reads commands from fd in large blocks and runs them without a prompt
+//a script on stdin is shared with the commands it runs, so they must find their input
+//right after the current line: a pipe is read one byte at a time, a file is seeked back
+//returns the exit status of the last command
+int run_batch(int fd){
+	size_t cap = 65536, start = 0, end = 0;
+	char *buf = malloc(cap + 1);
+	bool eof = false;
+	bool shared = fd == STDIN_FILENO;
+	bool seekable = shared && lseek(fd, 0, SEEK_CUR) != -1;
+
+	while (1)
+	{
+		char *nl = memchr(buf + start, '\n', end - start);
+		if (nl == NULL && !eof)
+		{
+			// keep the partial line, make room for the next block
+			if (start > 0)
+			{
+				memmove(buf, buf + start, end - start);
+				end -= start;
+				start = 0;
+			}
+			if (end == cap)
+			{
+				cap *= 2;
+				buf = realloc(buf, cap + 1);
+			}
+			ssize_t n = read(fd, buf + end, shared && !seekable ? 1 : cap - end);
+			if (n == -1 && errno == EINTR)
+				continue;
+			if (n <= 0)
+				eof = true;
+			else
+				end += n;
+			continue;
+		}
+		if (nl == NULL)
+		{
+			if (start == end)
+				break;
+			nl = buf + end; // last line without a newline
+		}
+		*nl = 0;
+		size_t next = nl - buf + 1;
+		if (next > end)
+			next = end;
+		off_t line_end = -1;
+		if (seekable && next < end)
+			line_end = lseek(fd, (off_t)next - (off_t)end, SEEK_CUR);
+		int code = run_batch_line(buf + start);
+		start = next;
+		if (line_end != -1)
+		{
+			// keep the buffered lines unless the command read from the script
+			if (lseek(fd, 0, SEEK_CUR) == line_end)
+				lseek(fd, end - next, SEEK_CUR);
+			else
+			{
+				start = end = 0;
+				eof = false;
+			}
+		}
+		if (code == EXIT)
+			break;
+	}
+	free(buf);
+	fflush(stdout);
+	if (fd != STDIN_FILENO)
+		close(fd);
+	return last_status;
+}
+// BATCH MODE HELPER METHODS END //
+
+
+// PARSER HELPER METHODS START //
+
+//returns size bytes aligned for any type, a new block is chained when the current one is full
+void *arena_alloc(struct arena **arena, size_t size){
+	size = (size + _Alignof(max_align_t) - 1) & ~(size_t)(_Alignof(max_align_t) - 1);
+	struct arena *block = *arena;
+	if (block == NULL || block->size - block->used < size)
+	{
+		size_t block_size = size > 4096 - sizeof(struct arena) ? size : 4096 - sizeof(struct arena);
+		block = malloc(sizeof(struct arena) + block_size);
+		block->next = *arena;
+		block->used = 0;
+		block->size = block_size;
+		*arena = block;
+	}
+	void *mem = block->data + block->used;
+	block->used += size;
+	return mem;
+}
+
+//frees every block of an arena
+void arena_release(struct arena *arena){
+	while (arena)
+	{
+		struct arena *next = arena->next;
+		free(arena);
+		arena = next;
+	}
+}
+
+//parses generated command lines until the given amount of input is consumed
+//and reports the parse cost per line and per megabyte
+void parse_benchmark(int megabytes){
+	static const char *samples[] = {
+		"ls -la /usr/local/bin",
+		"grep -i \"error code\" server.log | sort | uniq -c > counts.txt",
+		"highlight 'request id' r access.log",
+		"cat a.txt b.txt c.txt|wc -l &",
+		"kdiff -a old\\ version.txt new.txt >> diff.log",
+		"echo \"nested \\\"quotes\\\" and spaces\" | tr a-z A-Z | tee out.txt",
+		"shortdir jump project",
+		"gcc -O2 -Wall -o seashell seashell.c -lpthread",
+	};
+	int sample_count = sizeof(samples) / sizeof(samples[0]);
+	size_t target = (size_t)megabytes << 20, bytes = 0, lines = 0;
+	struct command_t command;
+
+	struct timespec start, end;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	while (bytes < target)
+	{
+		const char *line = samples[lines % sample_count];
+		memset(&command, 0, sizeof(command));
+		parse_command((char *)line, &command);
+		arena_release(command.arena);
+		bytes += strlen(line) + 1;
+		lines++;
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	double seconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+	double mb = bytes / 1048576.0;
+	printf("parsed %zu lines (%.1f MB) in %.3fs\n", lines, mb, seconds);
+	printf("%.1f ns/line, %.2f ms/MB, %.1f MB/s\n", seconds * 1e9 / lines, seconds * 1e3 / mb, mb / seconds);
+}
+// PARSER HELPER METHODS END //
+
+
+// PROMPT HELPER METHODS START //
+
+//the prompt is built from $SEASHELL_PROMPT (default "\u@\h:\w \s\g$ ") where
+//\u user, \h host, \w working directory, \W its last part, \s shell name,
+//\g git branch and a '*' when there are uncommitted changes, \j jobs, \? last status,
+//\$ '#' for root and '$' otherwise, \e escape, \\ backslash.
+//user and host are read once, the working directory only after cd and jump, and git
+//runs on a worker thread: the prompt is drawn with the last known git segment and the
+//line editor redraws it when the worker writes to prompt_notify_fd
+struct prompt_cache
+{
+	char user[256];
+	char host[256];
+	char cwd[4096];
+	bool ready;
+	char *git_path; // NULL when git is not installed
+
+	pthread_mutex_t lock; // the fields below are shared with the worker
+	pthread_cond_t wake;
+	bool worker_started;
+	unsigned long requested; // the worker is done when finished == requested
+	unsigned long finished;
+	char request_cwd[4096];
+	char git[256];		   // last git segment
+	char git_cwd[4096];	   // the directory it belongs to
+	int notify[2];
+} prompt_cache = {.lock = PTHREAD_MUTEX_INITIALIZER, .wake = PTHREAD_COND_INITIALIZER, .notify = {-1, -1}};
+
+int prompt_notify_fd = -1;
+
+//called after the shell changed its directory
+void prompt_cwd_changed(){
+	if (getcwd(prompt_cache.cwd, sizeof(prompt_cache.cwd)) == NULL)
+		strcpy(prompt_cache.cwd, "?");
+}
+
+//runs git status in dir and turns its first line into " (branch)" or " (branch*)"
+//reap_children only waits for the pids of jobs, so the worker waits for its git itself
+void prompt_git_segment(const char *dir, char *segment, size_t size){
+	int fds[2];
+	segment[0] = 0;
+	if (pipe2(fds, O_CLOEXEC) == -1)
+		return;
+	char *argv[] = {"git", "--no-optional-locks", "-C", (char *)dir, "status", "--porcelain=v1", "-b", "-uno", NULL};
+	posix_spawn_file_actions_t actions;
+	posix_spawn_file_actions_init(&actions);
+	posix_spawn_file_actions_addopen(&actions, STDIN_FILENO, "/dev/null", O_RDONLY, 0);
+	posix_spawn_file_actions_adddup2(&actions, fds[1], STDOUT_FILENO);
+	posix_spawn_file_actions_addopen(&actions, STDERR_FILENO, "/dev/null", O_WRONLY, 0);
+	pid_t pid;
+	int r = posix_spawn(&pid, prompt_cache.git_path, &actions, NULL, argv, environ);
+	posix_spawn_file_actions_destroy(&actions);
+	close(fds[1]);
+	if (r != 0)
+	{
+		close(fds[0]);
+		return;
+	}
+
+	char buf[4096];
+	size_t len = 0;
+	ssize_t n;
+	bool dirty = false;
+	while ((n = read(fds[0], buf + len, sizeof(buf) - 1 - len)) > 0 || (n == -1 && errno == EINTR))
+	{
+		if (n <= 0)
+			continue;
+		len += n;
+		char *nl = memchr(buf, '\n', len);
+		if (nl && nl + 1 < buf + len)
+			dirty = true; // a line after the branch line is a changed file
+		if (len == sizeof(buf) - 1)
+			len = nl ? (size_t)(nl - buf + 1) : 0; // the branch line is all that is kept
+	}
+	close(fds[0]);
+	int status;
+	while (waitpid(pid, &status, 0) == -1 && errno == EINTR)
+		;
+	buf[len] = 0;
+	if (!WIFEXITED(status) || WEXITSTATUS(status) != 0 || strncmp(buf, "## ", 3) != 0)
+		return;
+
+	// "## main...origin/main [ahead 1]", "## No commits yet on main", "## HEAD (no branch)"
+	char *branch = buf + 3;
+	if (strncmp(branch, "No commits yet on ", 18) == 0)
+		branch += 18;
+	branch[strcspn(branch, ".\n ")] = 0;
+	if (strcmp(branch, "HEAD") == 0)
+		branch = "detached";
+	snprintf(segment, size, " (%s%s)", branch, dirty ? "*" : "");
+}
+
+void *prompt_worker(void *arg){
+	(void)arg;
+	pthread_mutex_lock(&prompt_cache.lock);
+	while (1)
+	{
+		while (prompt_cache.finished == prompt_cache.requested)
+			pthread_cond_wait(&prompt_cache.wake, &prompt_cache.lock);
+		unsigned long request = prompt_cache.requested;
+		char dir[4096], segment[256];
+		strcpy(dir, prompt_cache.request_cwd);
+		pthread_mutex_unlock(&prompt_cache.lock);
+
+		prompt_git_segment(dir, segment, sizeof(segment));
+
+		pthread_mutex_lock(&prompt_cache.lock);
+		bool changed = strcmp(segment, prompt_cache.git) != 0 || strcmp(dir, prompt_cache.git_cwd) != 0;
+		strcpy(prompt_cache.git, segment);
+		strcpy(prompt_cache.git_cwd, dir);
+		prompt_cache.finished = request;
+		if (changed)
+			write(prompt_cache.notify[1], "", 1);
+	}
+	return NULL;
+}
+
+//asks the worker to look at git again, a command may have changed the repository
+void prompt_request_git(){
+	if (prompt_cache.git_path == NULL)
+		return;
+	pthread_mutex_lock(&prompt_cache.lock);
+	if (!prompt_cache.worker_started)
+	{
+		pthread_t thread;
+		pipe2(prompt_cache.notify, O_CLOEXEC | O_NONBLOCK);
+		prompt_notify_fd = prompt_cache.notify[0];
+		prompt_cache.worker_started = pthread_create(&thread, NULL, prompt_worker, NULL) == 0;
+		if (prompt_cache.worker_started)
+			pthread_detach(thread);
+	}
+	strcpy(prompt_cache.request_cwd, prompt_cache.cwd);
+	prompt_cache.requested++;
+	pthread_cond_signal(&prompt_cache.wake);
+	pthread_mutex_unlock(&prompt_cache.lock);
+}
+
+void prompt_cache_init(){
+	const char *user = getenv("USER");
+	snprintf(prompt_cache.user, sizeof(prompt_cache.user), "%s", user ? user : "");
+	if (gethostname(prompt_cache.host, sizeof(prompt_cache.host)) == -1)
+		strcpy(prompt_cache.host, "?");
+	prompt_cwd_changed();
+	const char *git = getenv("SEASHELL_PROMPT") == NULL || strstr(getenv("SEASHELL_PROMPT"), "\\g") ? resolve_command("git") : NULL;
+	prompt_cache.git_path = git ? strdup(git) : NULL;
+	prompt_cache.ready = true;
+}
+
+//writes the prompt into out from the cached pieces
+void prompt_format(char *out, size_t size){
+	if (!prompt_cache.ready)
+		prompt_cache_init();
+	const char *format = getenv("SEASHELL_PROMPT");
+	if (format == NULL)
+		format = "\\u@\\h:\\w \\s\\g$ ";
+
+	size_t len = 0;
+	char piece[4096 + 64];
+	for (const char *p = format; *p && len + 1 < size; p++)
+	{
+		const char *text = piece;
+		piece[0] = 0;
+		if (*p != '\\' || p[1] == 0)
+			piece[0] = *p, piece[1] = 0;
+		else
+		{
+			switch (*++p)
+			{
+			case 'u':
+				text = prompt_cache.user;
+				break;
+			case 'h':
+				text = prompt_cache.host;
+				break;
+			case 'w':
+				text = prompt_cache.cwd;
+				break;
+			case 'W':
+				text = strrchr(prompt_cache.cwd, '/') && prompt_cache.cwd[1] ? strrchr(prompt_cache.cwd, '/') + 1 : prompt_cache.cwd;
+				break;
+			case 's':
+				text = sysname;
+				break;
+			case 'g':
+				pthread_mutex_lock(&prompt_cache.lock);
+				if (strcmp(prompt_cache.git_cwd, prompt_cache.cwd) == 0)
+					strcpy(piece, prompt_cache.git);
+				pthread_mutex_unlock(&prompt_cache.lock);
+				break;
+			case 'j':
+			{
+				int jobs = 0;
+				for (struct job *j = job_list; j; j = j->next)
+					jobs++;
+				sprintf(piece, "%d", jobs);
+				break;
+			}
+			case '?':
+				sprintf(piece, "%d", last_status);
+				break;
+			case '$':
+				strcpy(piece, geteuid() == 0 ? "#" : "$");
+				break;
+			case 'e':
+				strcpy(piece, "\x1b");
+				break;
+			default:
+				piece[0] = *p, piece[1] = 0;
+			}
+		}
+		size_t n = strlen(text);
+		if (len + n >= size)
+			n = size - len - 1;
+		memcpy(out + len, text, n);
+		len += n;
+	}
+	out[len] = 0;
+}
+// PROMPT HELPER METHODS END //
+
+
+// LINE EDITOR HELPER METHODS START //
+
+//the line being edited is kept in a gap buffer: the text before the cursor is at the start
+//of data and the text after it at the end, so typing or deleting at the cursor moves nothing.
+//after every key the new line is compared with the one on the screen and only the changed
+//tail is redrawn, everything a key changes on the screen goes out in one write()
+struct gap_buffer
+{
+	char *data;
+	size_t cap;
+	size_t gap_start; // the cursor
+	size_t gap_end;
+};
+
+struct line_editor
+{
+	struct gap_buffer line;
+	char *prompt;
+	size_t prompt_len;
+	size_t prompt_columns;
+	size_t width; // of the terminal, read before every redraw
+	size_t shown_row; // rows between the first row of the prompt and the cursor
+	char *shown; // the line as it is on the screen
+	size_t shown_len;
+	size_t shown_cap;
+	size_t shown_cursor;
+	char *render; // the line as it should be, built before every redraw
+	size_t render_cap;
+	struct outbuf out;
+	char *saved; // the line being typed while browsing or searching the history
+	int history_pos;
+	bool searching; // Ctrl-R
+	char search[256];
+	size_t search_len;
+	int search_match; // -1 when nothing matches
+};
+
+enum line_keys
+{
+	KEY_UP = 1000,
+	KEY_DOWN,
+	KEY_LEFT,
+	KEY_RIGHT,
+	KEY_HOME,
+	KEY_END,
+	KEY_DELETE,
+	KEY_WORD_LEFT,
+	KEY_WORD_RIGHT,
+	KEY_KILL_WORD,
+	KEY_EOF,
+	KEY_REPAINT, // the prompt changed
+};
+
+#define CTRL_KEY(c) ((c) & 0x1f)
+
+//the history is kept in ~/.seashell_history, one command per line. every session appends
+//its commands with a single locked write; the file is only mapped when Up or Ctrl-R is
+//first pressed, entries point into the mapping and new ones are copied to the heap.
+//Ctrl-R looks a query up in a trigram index built on the first search: only the entries
+//in the posting list of the query's rarest trigram are checked with memmem.
+//characters are folded to 64 classes so the index is a direct table of 2^18 lists
+struct history_entry
+{
+	const char *text;
+	uint32_t len;
+};
+
+#define TRIGRAM_COUNT (1 << 18)
+
+struct history
+{
+	struct history_entry *entries;
+	int count;
+	int cap;
+	bool loaded;
+	char *map;
+	size_t map_size;
+	char *last; // the last line this session added, repeated lines are stored once
+	uint32_t *index_start; // list t is index_ids[index_start[t]] up to index_start[t + 1], NULL until the first search
+	uint32_t *index_ids;   // the posting lists one after the other, ascending entry numbers
+	int indexed; // entries added after the index was built are searched without it
+} history;
+
+char *line_kill;	// the last killed text, Ctrl-Y inserts it again
+size_t line_kill_len;
+
+static inline bool utf8_continuation(char c){
+	return ((unsigned char)c & 0xc0) == 0x80;
+}
+
+size_t gap_length(struct gap_buffer *g){
+	return g->cap - (g->gap_end - g->gap_start);
+}
+
+char gap_at(struct gap_buffer *g, size_t i){
+	return i < g->gap_start ? g->data[i] : g->data[i + g->gap_end - g->gap_start];
+}
+
+//copies bytes [from, to) of the text to dst
+void gap_copy(struct gap_buffer *g, size_t from, size_t to, char *dst){
+	for (; from < to && from < g->gap_start; from++)
+		*dst++ = g->data[from];
+	if (from < to)
+		memcpy(dst, g->data + g->gap_end + (from - g->gap_start), to - from);
+}
+
+void gap_move(struct gap_buffer *g, size_t pos){
+	if (pos < g->gap_start)
+	{
+		size_t n = g->gap_start - pos;
+		memmove(g->data + g->gap_end - n, g->data + pos, n);
+		g->gap_start -= n;
+		g->gap_end -= n;
+	}
+	else if (pos > g->gap_start)
+	{
+		size_t n = pos - g->gap_start;
+		memmove(g->data + g->gap_start, g->data + g->gap_end, n);
+		g->gap_start += n;
+		g->gap_end += n;
+	}
+}
+
+void gap_insert(struct gap_buffer *g, const char *text, size_t n){
+	if (g->gap_end - g->gap_start < n)
+	{
+		size_t len = gap_length(g);
+		size_t after = g->cap - g->gap_end;
+		size_t cap = g->cap * 2 > len + n + 64 ? g->cap * 2 : len + n + 64;
+		char *data = malloc(cap);
+		memcpy(data, g->data, g->gap_start);
+		memcpy(data + cap - after, g->data + g->gap_end, after);
+		free(g->data);
+		g->data = data;
+		g->gap_end = cap - after;
+		g->cap = cap;
+	}
+	memcpy(g->data + g->gap_start, text, n);
+	g->gap_start += n;
+}
+
+//removes bytes [from, to) and leaves the cursor at from
+void gap_delete(struct gap_buffer *g, size_t from, size_t to){
+	gap_move(g, to);
+	g->gap_start = from;
+}
+
+//replaces the whole text and puts the cursor at its end
+void gap_set(struct gap_buffer *g, const char *text, size_t len){
+	g->gap_start = 0;
+	g->gap_end = g->cap;
+	gap_insert(g, text, len);
+}
+
+//returns the text as a malloc'd string
+char *gap_string(struct gap_buffer *g){
+	size_t len = gap_length(g);
+	char *str = malloc(len + 1);
+	gap_copy(g, 0, len, str);
+	str[len] = 0;
+	return str;
+}
+
+//letters ignore case, digits keep their own class and everything else shares 28 classes
+unsigned char trigram_classes[256];
+
+void trigram_classes_init(){
+	for (int c = 0; c < 256; c++)
+	{
+		if ((c | 0x20) >= 'a' && (c | 0x20) <= 'z')
+			trigram_classes[c] = (c | 0x20) - 'a';
+		else if (c >= '0' && c <= '9')
+			trigram_classes[c] = 26 + c - '0';
+		else
+			trigram_classes[c] = 36 + c % 28;
+	}
+}
+
+static inline uint32_t trigram_at(const char *p){
+	return trigram_classes[(unsigned char)p[0]] | trigram_classes[(unsigned char)p[1]] << 6 |
+		   trigram_classes[(unsigned char)p[2]] << 12;
+}
+
+//builds the index in two passes: the first counts the entries of every trigram,
+//the second stores them into one array so each posting list is contiguous
+void history_build_index(){
+	struct
+	{
+		uint32_t count; // after the first pass the next free slot of the list
+		uint32_t last;	// a trigram repeated in a line is counted once
+	} *lists = malloc(sizeof(*lists) * TRIGRAM_COUNT);
+	trigram_classes_init();
+	memset(lists, 0xff, sizeof(*lists) * TRIGRAM_COUNT);
+	for (uint32_t t = 0; t < TRIGRAM_COUNT; t++)
+		lists[t].count = 0;
+	for (int id = 0; id < history.count; id++)
+	{
+		const char *text = history.entries[id].text;
+		for (uint32_t i = 0; i + 3 <= history.entries[id].len; i++)
+		{
+			uint32_t t = trigram_at(text + i);
+			if (lists[t].last != (uint32_t)id)
+				lists[t].count++, lists[t].last = id;
+		}
+	}
+
+	history.index_start = malloc(sizeof(uint32_t) * (TRIGRAM_COUNT + 1));
+	uint32_t total = 0;
+	for (uint32_t t = 0; t < TRIGRAM_COUNT; t++)
+	{
+		history.index_start[t] = total;
+		total += lists[t].count;
+		lists[t].count = history.index_start[t];
+		lists[t].last = UINT32_MAX;
+	}
+	history.index_start[TRIGRAM_COUNT] = total;
+	history.index_ids = malloc(sizeof(uint32_t) * (total + 1));
+	for (int id = 0; id < history.count; id++)
+	{
+		const char *text = history.entries[id].text;
+		for (uint32_t i = 0; i + 3 <= history.entries[id].len; i++)
+		{
+			uint32_t t = trigram_at(text + i);
+			if (lists[t].last != (uint32_t)id)
+				history.index_ids[lists[t].count++] = id, lists[t].last = id;
+		}
+	}
+	history.indexed = history.count;
+	free(lists);
+}
+
+void history_push(const char *text, uint32_t len){
+	if (history.count == history.cap)
+	{
+		history.cap = history.cap ? history.cap * 2 : 256;
+		history.entries = realloc(history.entries, sizeof(struct history_entry) * history.cap);
+	}
+	history.entries[history.count].text = text;
+	history.entries[history.count].len = len;
+	history.count++;
+}
+
+//maps the history file and splits it into entries, done once per session
+void history_load(){
+	if (history.loaded)
+		return;
+	history.loaded = true;
+	if (history_path[0] == 0)
+		return;
+	int fd = open(history_path, O_RDONLY | O_CLOEXEC);
+	struct stat st;
+	if (fd == -1)
+		return;
+	if (fstat(fd, &st) == 0 && st.st_size > 0)
+	{
+		void *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (map != MAP_FAILED)
+		{
+			history.map = map;
+			history.map_size = st.st_size;
+			madvise(map, st.st_size, MADV_SEQUENTIAL);
+			// a line another session is still writing has no newline yet and is skipped
+			const char *p = map, *end = p + st.st_size, *nl;
+			while ((nl = memchr(p, '\n', end - p)) != NULL)
+			{
+				if (nl > p)
+					history_push(p, nl - p);
+				p = nl + 1;
+			}
+		}
+	}
+	close(fd);
+}
+
+int history_count(){
+	history_load();
+	return history.count;
+}
+
+const char *history_get(int i, size_t *len){
+	*len = history.entries[i].len;
+	return history.entries[i].text;
+}
+
+//remembers a line entered at the prompt and appends it to the history file
+void history_add(const char *line){
+	size_t len = strlen(line);
+	if (len == 0 || (history.last && strcmp(history.last, line) == 0))
+		return;
+	free(history.last);
+	history.last = strdup(line);
+	if (history.loaded)
+		history_push(strdup(line), len);
+	if (history_path[0] == 0)
+		return;
+
+	int fd = open(history_path, O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0600);
+	if (fd == -1)
+		return;
+	char *record = malloc(len + 1);
+	memcpy(record, line, len);
+	record[len] = '\n';
+	flock(fd, LOCK_EX);
+	write_all(fd, record, len + 1);
+	flock(fd, LOCK_UN);
+	close(fd);
+	free(record);
+}
+
+//the newest entry before the given one that contains query, -1 if there is none
+int history_search(const char *query, int before){
+	size_t query_len = strlen(query);
+	history_load();
+	if (before > history.count)
+		before = history.count;
+	if (query_len < 3)
+	{
+		for (int i = before - 1; i >= 0; i--)
+			if (memmem(history.entries[i].text, history.entries[i].len, query, query_len))
+				return i;
+		return -1;
+	}
+
+	if (history.index_start == NULL)
+		history_build_index();
+	// lines added since the index was built are newer than everything in it
+	for (int i = before - 1; i >= history.indexed; i--)
+		if (memmem(history.entries[i].text, history.entries[i].len, query, query_len))
+			return i;
+	if (before > history.indexed)
+		before = history.indexed;
+
+	// every match contains all trigrams of the query, so the shortest list has them all
+	uint32_t rarest = trigram_at(query);
+	for (size_t i = 1; i + 3 <= query_len; i++)
+	{
+		uint32_t t = trigram_at(query + i);
+		if (history.index_start[t + 1] - history.index_start[t] < history.index_start[rarest + 1] - history.index_start[rarest])
+			rarest = t;
+	}
+	// the last id below before, then downwards
+	uint32_t *ids = history.index_ids + history.index_start[rarest];
+	size_t lo = 0, hi = history.index_start[rarest + 1] - history.index_start[rarest];
+	while (lo < hi)
+	{
+		size_t mid = (lo + hi) / 2;
+		if (ids[mid] < (uint32_t)before)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	while (lo-- > 0)
+	{
+		struct history_entry *e = &history.entries[ids[lo]];
+		if (memmem(e->text, e->len, query, query_len))
+			return ids[lo];
+	}
+	return -1;
+}
+
+//terminal columns taken by n bytes of UTF-8 text
+size_t line_columns(const char *text, size_t n){
+	size_t columns = 0;
+	for (size_t i = 0; i < n; i++)
+		columns += !utf8_continuation(text[i]);
+	return columns;
+}
+
+//terminal columns taken by the prompt, escape sequences such as colors take none
+size_t line_prompt_columns(const char *prompt, size_t len){
+	size_t columns = 0;
+	for (size_t i = 0; i < len; i++)
+	{
+		if (prompt[i] == '\x1b' && i + 1 < len && prompt[i + 1] == '[')
+		{
+			for (i += 2; i < len && !(prompt[i] >= 0x40 && prompt[i] <= 0x7e); i++)
+				; // up to the final byte of the sequence
+			continue;
+		}
+		columns += !utf8_continuation(prompt[i]);
+	}
+	return columns;
+}
+
+//screen position of byte n of text, in columns from the start of the prompt
+//the prompt and the line wrap every ed->width columns
+size_t line_position(struct line_editor *ed, const char *text, size_t n){
+	return ed->prompt_columns + line_columns(text, n);
+}
+
+//moves the terminal cursor between two screen positions, across rows when the line wraps
+void line_cursor_move(struct line_editor *ed, size_t from, size_t to){
+	char seq[32];
+	size_t from_row = from / ed->width, to_row = to / ed->width;
+	size_t from_col = from % ed->width, to_col = to % ed->width;
+	if (to_row < from_row)
+		outbuf_put(&ed->out, seq, sprintf(seq, "\x1b[%zuA", from_row - to_row));
+	else if (to_row > from_row)
+		outbuf_put(&ed->out, seq, sprintf(seq, "\x1b[%zuB", to_row - from_row));
+	if (to_col < from_col)
+		outbuf_put(&ed->out, seq, sprintf(seq, "\x1b[%zuD", from_col - to_col));
+	else if (to_col > from_col)
+		outbuf_put(&ed->out, seq, sprintf(seq, "\x1b[%zuC", to_col - from_col));
+	ed->shown_row = to_row;
+}
+
+//called after text that ends at screen position end was written
+//a terminal that filled the last column waits before wrapping, the cursor is moved
+//to the next row so that positions and rows keep matching
+void line_wrote_up_to(struct line_editor *ed, size_t end){
+	if (end > 0 && end % ed->width == 0)
+		outbuf_put(&ed->out, "\r\n", 2);
+	ed->shown_row = end / ed->width;
+}
+
+//moves the terminal cursor back to the start of the first row of the prompt
+void line_cursor_home(struct line_editor *ed){
+	char seq[32];
+	if (ed->shown_row > 0)
+		outbuf_put(&ed->out, seq, sprintf(seq, "\x1b[%zuA", ed->shown_row));
+	outbuf_put(&ed->out, "\r", 1);
+	ed->shown_row = 0;
+}
+
+//brings the screen up to date with the line, only the part after the first difference is written
+//with full set the prompt is drawn again as well
+void line_redraw(struct line_editor *ed, bool full){
+	size_t len = gap_length(&ed->line);
+	size_t cursor = ed->line.gap_start;
+	if (len + 1 > ed->render_cap)
+	{
+		ed->render_cap = len + 256;
+		ed->render = realloc(ed->render, ed->render_cap);
+	}
+	gap_copy(&ed->line, 0, len, ed->render);
+	struct winsize ws;
+	ed->width = ioctl(STDOUT_FILENO, TIOCGWINSZ, &ws) == 0 && ws.ws_col > 0 ? ws.ws_col : 80;
+	size_t end = line_position(ed, ed->render, len);
+
+	if (full)
+	{
+		line_cursor_home(ed);
+		outbuf_put(&ed->out, ed->prompt, ed->prompt_len);
+		outbuf_put(&ed->out, ed->render, len);
+		line_wrote_up_to(ed, end);
+		outbuf_put(&ed->out, "\x1b[J", 3); // the rows of a longer line are cleared too
+		line_cursor_move(ed, end, line_position(ed, ed->render, cursor));
+	}
+	else
+	{
+		size_t same = 0;
+		while (same < len && same < ed->shown_len && ed->render[same] == ed->shown[same])
+			same++;
+		// a character that only partly changed is written whole
+		while (same > 0 && ((same < len && utf8_continuation(ed->render[same])) ||
+							(same < ed->shown_len && utf8_continuation(ed->shown[same]))))
+			same--;
+		size_t shown_cursor = line_position(ed, ed->shown, ed->shown_cursor);
+		if (same == len && same == ed->shown_len)
+			line_cursor_move(ed, shown_cursor, line_position(ed, ed->render, cursor));
+		else
+		{
+			// the text before same is the same on the screen and in the line
+			line_cursor_move(ed, shown_cursor, line_position(ed, ed->render, same));
+			if (same < len)
+			{
+				outbuf_put(&ed->out, ed->render + same, len - same);
+				line_wrote_up_to(ed, end);
+			}
+			if (line_position(ed, ed->shown, ed->shown_len) > end)
+				outbuf_put(&ed->out, "\x1b[J", 3);
+			line_cursor_move(ed, end, line_position(ed, ed->render, cursor));
+		}
+	}
+
+	char *tmp = ed->shown;
+	ed->shown = ed->render;
+	ed->render = tmp;
+	size_t tmp_cap = ed->shown_cap;
+	ed->shown_cap = ed->render_cap;
+	ed->render_cap = tmp_cap;
+	ed->shown_len = len;
+	ed->shown_cursor = cursor;
+	outbuf_flush(&ed->out);
+}
+
+//draws the Ctrl-R line in place of the prompt
+void line_redraw_search(struct line_editor *ed){
+	size_t match_len = 0;
+	const char *match = ed->search_match >= 0 ? history_get(ed->search_match, &match_len) : "";
+	const char *label = ed->search_match < 0 && ed->search_len > 0 ? "(failed reverse-i-search)`" : "(reverse-i-search)`";
+	line_cursor_home(ed);
+	outbuf_put(&ed->out, label, strlen(label));
+	outbuf_put(&ed->out, ed->search, ed->search_len);
+	outbuf_put(&ed->out, "': ", 3);
+	outbuf_put(&ed->out, match, match_len);
+	line_wrote_up_to(ed, strlen(label) + line_columns(ed->search, ed->search_len) + 3 + line_columns(match, match_len));
+	outbuf_put(&ed->out, "\x1b[J", 3);
+	outbuf_flush(&ed->out);
+}
+
+//reads one key, escape sequences of the arrow and editing keys are returned as one KEY_ code
+int line_read_key(){
+	unsigned char c;
+	ssize_t n;
+	if (prompt_notify_fd != -1)
+	{
+		struct pollfd fds[2] = {{STDIN_FILENO, POLLIN, 0}, {prompt_notify_fd, POLLIN, 0}};
+		while (poll(fds, 2, -1) == -1 && errno == EINTR)
+			;
+		if (!(fds[0].revents & (POLLIN | POLLHUP | POLLERR)))
+		{
+			char drain[64];
+			while (read(prompt_notify_fd, drain, sizeof(drain)) > 0)
+				;
+			return KEY_REPAINT;
+		}
+	}
+	while ((n = read(STDIN_FILENO, &c, 1)) == -1 && errno == EINTR)
+		;
+	if (n != 1)
+		return KEY_EOF;
+	if (c != 27)
+		return c;
+
+	if (read(STDIN_FILENO, &c, 1) != 1)
+		return 27;
+	if (c == 'b')
+		return KEY_WORD_LEFT;
+	if (c == 'f')
+		return KEY_WORD_RIGHT;
+	if (c == 'd')
+		return KEY_KILL_WORD;
+	if (c != '[' && c != 'O')
+		return 27;
+
+	// CSI parameters end with a byte in 0x40-0x7e
+	char params[16];
+	size_t len = 0;
+	while (read(STDIN_FILENO, &c, 1) == 1 && (c < 0x40 || c > 0x7e))
+		if (len < sizeof(params) - 1)
+			params[len++] = c;
+	params[len] = 0;
+	switch (c)
+	{
+	case 'A':
+		return KEY_UP;
+	case 'B':
+		return KEY_DOWN;
+	case 'C':
+		return strcmp(params, "1;5") == 0 ? KEY_WORD_RIGHT : KEY_RIGHT;
+	case 'D':
+		return strcmp(params, "1;5") == 0 ? KEY_WORD_LEFT : KEY_LEFT;
+	case 'H':
+		return KEY_HOME;
+	case 'F':
+		return KEY_END;
+	case '~':
+		if (strcmp(params, "1") == 0 || strcmp(params, "7") == 0)
+			return KEY_HOME;
+		if (strcmp(params, "4") == 0 || strcmp(params, "8") == 0)
+			return KEY_END;
+		if (strcmp(params, "3") == 0)
+			return KEY_DELETE;
+	}
+	return 27;
+}
+
+//start of the word before pos, words are separated by spaces
+size_t line_word_left(struct gap_buffer *g, size_t pos){
+	while (pos > 0 && gap_at(g, pos - 1) == ' ')
+		pos--;
+	while (pos > 0 && gap_at(g, pos - 1) != ' ')
+		pos--;
+	return pos;
+}
+
+size_t line_word_right(struct gap_buffer *g, size_t pos){
+	size_t len = gap_length(g);
+	while (pos < len && gap_at(g, pos) == ' ')
+		pos++;
+	while (pos < len && gap_at(g, pos) != ' ')
+		pos++;
+	return pos;
+}
+
+//moves bytes [from, to) into the kill buffer and removes them from the line
+void line_kill_range(struct line_editor *ed, size_t from, size_t to){
+	if (from >= to)
+		return;
+	free(line_kill);
+	line_kill_len = to - from;
+	line_kill = malloc(line_kill_len);
+	gap_copy(&ed->line, from, to, line_kill);
+	gap_delete(&ed->line, from, to);
+}
+
+//replaces the line with a history entry, -1 is the line that was being typed
+void line_show_history(struct line_editor *ed, int pos){
+	if (ed->saved == NULL)
+		ed->saved = gap_string(&ed->line);
+	ed->history_pos = pos;
+	if (pos < history.count)
+	{
+		size_t len;
+		const char *text = history_get(pos, &len);
+		gap_set(&ed->line, text, len);
+	}
+	else
+		gap_set(&ed->line, ed->saved, strlen(ed->saved));
+}
+
+//handles a key while Ctrl-R is active, returns false if the key ends the search
+//and still has to be handled as a normal key
+bool line_search_key(struct line_editor *ed, int key){
+	if (key == CTRL_KEY('R'))
+	{
+		if (ed->search_match > 0)
+		{
+			int older = history_search(ed->search, ed->search_match);
+			if (older >= 0)
+				ed->search_match = older;
+		}
+	}
+	else if (key == 127 || key == CTRL_KEY('H'))
+	{
+		if (ed->search_len > 0)
+			ed->search[--ed->search_len] = 0;
+		ed->search_match = history_search(ed->search, history_count());
+	}
+	else if (key >= 32 && key < 256 && key != 127)
+	{
+		if (ed->search_len < sizeof(ed->search) - 1)
+			ed->search[ed->search_len++] = key;
+		ed->search[ed->search_len] = 0;
+		// the current match is kept while it still contains the longer query
+		int from = ed->search_match >= 0 ? ed->search_match + 1 : history_count();
+		ed->search_match = history_search(ed->search, from);
+	}
+	else
+	{
+		ed->searching = false;
+		if (key == CTRL_KEY('G') || key == CTRL_KEY('C'))
+		{
+			gap_set(&ed->line, ed->saved, strlen(ed->saved));
+			line_redraw(ed, true);
+			return true;
+		}
+		if (ed->search_match >= 0)
+		{
+			size_t len;
+			const char *text = history_get(ed->search_match, &len);
+			gap_set(&ed->line, text, len);
+			ed->history_pos = ed->search_match;
+		}
+		line_redraw(ed, true);
+		return false;
+	}
+	line_redraw_search(ed);
+	return true;
+}
+
+//reads one line from the terminal, which must already be in non-canonical mode
+//returns a malloc'd string, or NULL on Ctrl-D at an empty line or at the end of input
+char *line_edit(const char *prompt){
+	struct line_editor ed;
+	memset(&ed, 0, sizeof(ed));
+	ed.prompt = strdup(prompt);
+	ed.prompt_len = strlen(prompt);
+	ed.prompt_columns = line_prompt_columns(ed.prompt, ed.prompt_len);
+	ed.out = (struct outbuf){malloc(4096), 0, 4096, STDOUT_FILENO};
+	ed.history_pos = INT_MAX; // the history is loaded on the first Up or Ctrl-R
+	gap_set(&ed.line, "", 0);
+	fflush(stdout); // anything printed with stdio goes out before the prompt
+	line_redraw(&ed, true);
+
+	char *result = NULL;
+	bool done = false;
+	while (!done)
+	{
+		int key = line_read_key();
+		if (key == KEY_REPAINT)
+		{
+			prompt = show_prompt();
+			if (strcmp(prompt, ed.prompt) != 0)
+			{
+				free(ed.prompt);
+				ed.prompt = strdup(prompt);
+				ed.prompt_len = strlen(prompt);
+				ed.prompt_columns = line_prompt_columns(ed.prompt, ed.prompt_len);
+				if (!ed.searching)
+					line_redraw(&ed, true);
+			}
+			continue;
+		}
+		if (ed.searching && line_search_key(&ed, key))
+			continue;
+
+		struct gap_buffer *g = &ed.line;
+		size_t len = gap_length(g);
+		size_t cursor = g->gap_start;
+		switch (key)
+		{
+		case '\n':
+		case '\r':
+			gap_move(g, len);
+			line_redraw(&ed, false);
+			write_all(STDOUT_FILENO, "\n", 1);
+			result = gap_string(g);
+			done = true;
+			continue;
+		case '\t':
+			line_complete(&ed);
+			continue;
+		case KEY_EOF:
+			done = true;
+			continue;
+
+		case CTRL_KEY('D'):
+			if (len == 0)
+			{
+				done = true;
+				continue;
+			}
+			// Ctrl-D on a non-empty line deletes under the cursor
+			// fallthrough
+		case KEY_DELETE:
+			if (cursor < len)
+			{
+				size_t next = cursor + 1;
+				while (next < len && utf8_continuation(gap_at(g, next)))
+					next++;
+				gap_move(g, next);
+				gap_delete(g, cursor, next);
+			}
+			break;
+		case 127:
+		case CTRL_KEY('H'):
+			if (cursor > 0)
+			{
+				size_t prev = cursor - 1;
+				while (prev > 0 && utf8_continuation(gap_at(g, prev)))
+					prev--;
+				gap_delete(g, prev, cursor);
+			}
+			break;
+		case CTRL_KEY('B'):
+		case KEY_LEFT:
+			while (cursor > 0 && utf8_continuation(gap_at(g, --cursor)))
+				;
+			gap_move(g, cursor);
+			break;
+		case CTRL_KEY('F'):
+		case KEY_RIGHT:
+			if (cursor < len)
+				for (cursor++; cursor < len && utf8_continuation(gap_at(g, cursor)); cursor++)
+					;
+			gap_move(g, cursor);
+			break;
+		case CTRL_KEY('A'):
+		case KEY_HOME:
+			gap_move(g, 0);
+			break;
+		case CTRL_KEY('E'):
+		case KEY_END:
+			gap_move(g, len);
+			break;
+		case KEY_WORD_LEFT:
+			gap_move(g, line_word_left(g, cursor));
+			break;
+		case KEY_WORD_RIGHT:
+			gap_move(g, line_word_right(g, cursor));
+			break;
+		case CTRL_KEY('K'):
+			line_kill_range(&ed, cursor, len);
+			break;
+		case CTRL_KEY('U'):
+			line_kill_range(&ed, 0, cursor);
+			break;
+		case CTRL_KEY('W'):
+			line_kill_range(&ed, line_word_left(g, cursor), cursor);
+			break;
+		case KEY_KILL_WORD:
+			line_kill_range(&ed, cursor, line_word_right(g, cursor));
+			break;
+		case CTRL_KEY('Y'):
+			if (line_kill)
+				gap_insert(g, line_kill, line_kill_len);
+			break;
+		case KEY_UP:
+		case CTRL_KEY('P'):
+			if (ed.history_pos == INT_MAX)
+				ed.history_pos = history_count();
+			if (ed.history_pos > 0)
+				line_show_history(&ed, ed.history_pos - 1);
+			break;
+		case KEY_DOWN:
+		case CTRL_KEY('N'):
+			if (ed.history_pos < history_count())
+				line_show_history(&ed, ed.history_pos + 1);
+			break;
+		case CTRL_KEY('R'):
+			free(ed.saved);
+			ed.saved = gap_string(g);
+			ed.searching = true;
+			ed.search_len = 0;
+			ed.search[0] = 0;
+			ed.search_match = -1;
+			line_redraw_search(&ed);
+			continue;
+		case CTRL_KEY('C'):
+			// the line is dropped and a new prompt is drawn below it
+			gap_move(g, len);
+			line_redraw(&ed, false);
+			write_all(STDOUT_FILENO, "^C\n", 3);
+			gap_set(g, "", 0);
+			ed.shown_len = ed.shown_cursor = ed.shown_row = 0;
+			ed.history_pos = INT_MAX;
+			free(ed.saved);
+			ed.saved = NULL;
+			line_redraw(&ed, true);
+			continue;
+		case CTRL_KEY('L'):
+			outbuf_put(&ed.out, "\x1b[H\x1b[2J", 7);
+			ed.shown_row = 0;
+			line_redraw(&ed, true);
+			continue;
+		default:
+			if (key >= 32 && key < 256 && key != 127)
+			{
+				char c = key;
+				gap_insert(g, &c, 1);
+			}
+			break;
+		}
+		line_redraw(&ed, false);
+	}
+
+	free(ed.prompt);
+	free(ed.line.data);
+	free(ed.shown);
+	free(ed.render);
+	free(ed.saved);
+	free(ed.out.data);
+	return result;
+}
+// LINE EDITOR HELPER METHODS END //
+
+
+// COMPLETION HELPER METHODS START //
+
+//directory listings are cached together with the directory's mtime and read again only
+//when it changed (checked at most once a second per directory), names are kept sorted
+//so the names starting with a prefix are found with a binary search.
+//command names come from one sorted index of every $PATH directory plus the builtins,
+//rebuilt when one of those listings changes
+#define DIR_CACHE_MAX 64
+
+struct dir_listing
+{
+	char *path;
+	struct timespec mtime;
+	time_t checked;
+	unsigned long generation; // changes every time the listing is read again
+	char **names;
+	unsigned char *types; // d_type of every name
+	int count;
+	struct dir_listing *next; // most recently used first
+};
+
+struct completion
+{
+	char **names; // candidates, directories end with '/'
+	int count;
+	int cap;
+	size_t word_start; // the part of the line the candidates replace
+};
+
+struct
+{
+	char **names;
+	int *dirs; // $PATH directory of every name, -1 for builtins
+	int count;
+	unsigned long stamp; // generations of the $PATH listings it was built from
+} command_index;
+
+struct dir_listing *dir_cache;
+int dir_cache_count;
+unsigned long dir_generation;
+
+struct command_name
+{
+	const char *name;
+	int dir;
+};
+
+int name_compare(const void *a, const void *b){
+	return strcmp(*(char **)a, *(char **)b);
+}
+
+int command_name_compare(const void *a, const void *b){
+	const struct command_name *x = a, *y = b;
+	int cmp = strcmp(x->name, y->name);
+	return cmp ? cmp : x->dir - y->dir;
+}
+
+void dir_listing_free(struct dir_listing *d){
+	for (int i = 0; i < d->count; i++)
+		free(d->names[i]);
+	free(d->names);
+	free(d->types);
+	free(d->path);
+	free(d);
+}
+
+//reads the names of a directory and sorts them, returns -1 if it can not be opened
+int dir_listing_read(struct dir_listing *d){
+	DIR *dir = opendir(d->path);
+	if (dir == NULL)
+		return -1;
+	for (int i = 0; i < d->count; i++)
+		free(d->names[i]);
+	d->count = 0;
+	int cap = 64;
+	struct dirent *entry;
+	char **names = malloc(sizeof(char *) * cap);
+	while ((entry = readdir(dir)) != NULL)
+	{
+		if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0)
+			continue;
+		if (d->count + 1 >= cap)
+			names = realloc(names, sizeof(char *) * (cap *= 2));
+		// the type is kept after the terminating 0 until the names are sorted
+		size_t len = strlen(entry->d_name);
+		char *name = malloc(len + 2);
+		memcpy(name, entry->d_name, len + 1);
+		name[len + 1] = entry->d_type;
+		names[d->count++] = name;
+	}
+	closedir(dir);
+	qsort(names, d->count, sizeof(char *), name_compare);
+	free(d->names);
+	free(d->types);
+	d->names = names;
+	d->types = malloc(d->count + 1);
+	for (int i = 0; i < d->count; i++)
+		d->types[i] = names[i][strlen(names[i]) + 1];
+	d->generation = ++dir_generation;
+	return 0;
+}
+
+//returns the cached listing of a directory, NULL if it can not be read
+struct dir_listing *dir_listing_get(const char *path){
+	struct dir_listing **link = &dir_cache, *d;
+	while ((d = *link) && strcmp(d->path, path) != 0)
+		link = &d->next;
+	if (d)
+		*link = d->next; // moved to the front below
+	else
+	{
+		d = calloc(1, sizeof(struct dir_listing));
+		d->path = strdup(path);
+		d->mtime.tv_sec = -1;
+		dir_cache_count++;
+	}
+	d->next = dir_cache;
+	dir_cache = d;
+
+	time_t now = time(NULL);
+	if (d->checked != now)
+	{
+		struct stat st;
+		d->checked = now;
+		if (stat(path, &st) == -1 || !S_ISDIR(st.st_mode))
+			d->mtime.tv_sec = -1, d->count = 0;
+		else if (st.st_mtim.tv_sec != d->mtime.tv_sec || st.st_mtim.tv_nsec != d->mtime.tv_nsec)
+		{
+			d->mtime = st.st_mtim;
+			if (dir_listing_read(d) == -1)
+				d->count = 0;
+		}
+	}
+
+	// the least recently used listing is dropped
+	if (dir_cache_count > DIR_CACHE_MAX)
+	{
+		struct dir_listing **last = &dir_cache;
+		while ((*last)->next)
+			last = &(*last)->next;
+		dir_listing_free(*last);
+		*last = NULL;
+		dir_cache_count--;
+	}
+	return d->mtime.tv_sec == -1 ? NULL : d;
+}
+
+//number of sorted names starting with prefix, the first of them is stored in first
+int prefix_range(char **names, int count, const char *prefix, int *first){
+	size_t len = strlen(prefix);
+	int lo = 0, hi = count;
+	while (lo < hi)
+	{
+		int mid = (lo + hi) / 2;
+		if (strcmp(names[mid], prefix) < 0)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	*first = lo;
+	int end = lo;
+	while (end < count && strncmp(names[end], prefix, len) == 0)
+		end++;
+	return end - lo;
+}
+
+void completion_add(struct completion *c, const char *name, bool dir){
+	if (c->count == c->cap)
+	{
+		c->cap = c->cap ? c->cap * 2 : 32;
+		c->names = realloc(c->names, sizeof(char *) * c->cap);
+	}
+	size_t len = strlen(name);
+	char *copy = malloc(len + 2);
+	memcpy(copy, name, len);
+	if (dir)
+		copy[len++] = '/';
+	copy[len] = 0;
+	c->names[c->count++] = copy;
+}
+
+void completion_free(struct completion *c){
+	for (int i = 0; i < c->count; i++)
+		free(c->names[i]);
+	free(c->names);
+}
+
+//rebuilds the command index when $PATH or one of its directories changed
+void command_index_refresh(){
+	path_dirs_refresh();
+	unsigned long stamp = 0;
+	struct dir_listing **listings = malloc(sizeof(struct dir_listing *) * (path_dir_count + 1));
+	for (int i = 0; i < path_dir_count; i++)
+	{
+		listings[i] = dir_listing_get(path_dirs[i]);
+		stamp = stamp * 31 + (listings[i] ? listings[i]->generation : 0);
+	}
+	if (command_index.names && stamp == command_index.stamp)
+	{
+		free(listings);
+		return;
+	}
+
+	for (int i = 0; i < command_index.count; i++)
+		free(command_index.names[i]);
+	free(command_index.names);
+	free(command_index.dirs);
+	int total = 1;
+	for (int i = 0; builtin_names[i]; i++)
+		total++;
+	for (int i = 0; i < path_dir_count; i++)
+		total += listings[i] ? listings[i]->count : 0;
+
+	// names are tagged with their directory, sorted, and repeated names keep the first directory
+	struct command_name *all = malloc(sizeof(struct command_name) * total);
+	int n = 0;
+	all[n++].name = "exit";
+	for (int i = 0; builtin_names[i]; i++)
+		all[n++].name = builtin_names[i];
+	for (int i = 0; i < n; i++)
+		all[i].dir = -1;
+	for (int i = 0; i < path_dir_count; i++)
+		for (int j = 0; listings[i] && j < listings[i]->count; j++)
+			all[n].name = listings[i]->names[j], all[n++].dir = i;
+	qsort(all, n, sizeof(struct command_name), command_name_compare);
+
+	command_index.names = malloc(sizeof(char *) * (n + 1));
+	command_index.dirs = malloc(sizeof(int) * (n + 1));
+	command_index.count = 0;
+	for (int i = 0; i < n; i++)
+	{
+		if (i > 0 && strcmp(all[i].name, all[i - 1].name) == 0)
+			continue;
+		command_index.names[command_index.count] = strdup(all[i].name);
+		command_index.dirs[command_index.count++] = all[i].dir;
+	}
+	command_index.stamp = stamp;
+	free(all);
+	free(listings);
+}
+
+//builtins and executables in $PATH whose name starts with prefix
+void complete_commands(struct completion *c, const char *prefix){
+	int first;
+	command_index_refresh();
+	int n = prefix_range(command_index.names, command_index.count, prefix, &first);
+	for (int i = first; i < first + n; i++)
+	{
+		int dir = command_index.dirs[i];
+		if (dir >= 0)
+		{
+			// only the matching names are checked, not every file in $PATH
+			char path[4096];
+			struct stat st;
+			snprintf(path, sizeof(path), "%s/%s", path_dirs[dir], command_index.names[i]);
+			if (stat(path, &st) == -1 || !S_ISREG(st.st_mode) || access(path, X_OK) == -1)
+				continue;
+		}
+		completion_add(c, command_index.names[i], false);
+	}
+}
+
+//files in the directory part of word whose name starts with the rest of word
+//hidden files are only offered when the name starts with a dot
+void complete_files(struct completion *c, const char *word){
+	const char *slash = strrchr(word, '/');
+	const char *base = slash ? slash + 1 : word;
+	char dir[4096];
+	if (slash == NULL)
+		strcpy(dir, ".");
+	else if (slash == word)
+		strcpy(dir, "/");
+	else if (word[0] == '~' && word + 1 == slash && getenv("HOME"))
+		snprintf(dir, sizeof(dir), "%s", getenv("HOME"));
+	else if (word[0] == '~' && word[1] == '/' && getenv("HOME"))
+		snprintf(dir, sizeof(dir), "%s%.*s", getenv("HOME"), (int)(slash - word - 1), word + 1);
+	else
+		snprintf(dir, sizeof(dir), "%.*s", (int)(slash - word), word);
+
+	struct dir_listing *d = dir_listing_get(dir);
+	if (d == NULL)
+		return;
+	int first;
+	int n = prefix_range(d->names, d->count, base, &first);
+	for (int i = first; i < first + n; i++)
+	{
+		if (d->names[i][0] == '.' && base[0] != '.')
+			continue;
+		bool is_dir = d->types[i] == DT_DIR;
+		if (d->types[i] == DT_LNK || d->types[i] == DT_UNKNOWN)
+		{
+			char path[8192];
+			struct stat st;
+			snprintf(path, sizeof(path), "%s/%s", dir, d->names[i]);
+			is_dir = stat(path, &st) == 0 && S_ISDIR(st.st_mode);
+		}
+		completion_add(c, d->names[i], is_dir);
+	}
+}
+
+//shortdir aliases starting with prefix, sorted
+void complete_aliases(struct completion *c, const char *prefix){
+	size_t len = strlen(prefix);
+	int first = c->count;
+	shortdir_refresh();
+	for (size_t i = 0; i < shortdir.bucket_count; i++)
+		for (struct shortdir_entry *e = shortdir.by_name[i]; e; e = e->name_next)
+			if (strncmp(e->name, prefix, len) == 0)
+				completion_add(c, e->name, false);
+	qsort(c->names + first, c->count - first, sizeof(char *), name_compare);
+}
+
+//removes quotes and backslashes the way the parser does
+char *complete_unescape(const char *text, size_t len){
+	char *word = malloc(len + 1), *out = word;
+	char quote = 0;
+	for (size_t i = 0; i < len; i++)
+	{
+		if (quote && text[i] == quote)
+			quote = 0;
+		else if (!quote && (text[i] == '\'' || text[i] == '"'))
+			quote = text[i];
+		else if (text[i] == '\\' && quote != '\'' && i + 1 < len)
+			*out++ = text[++i];
+		else
+			*out++ = text[i];
+	}
+	*out = 0;
+	return word;
+}
+
+//the candidate with the characters the parser treats specially escaped
+char *complete_escape(const char *name, size_t len){
+	char *escaped = malloc(2 * len + 1), *out = escaped;
+	for (size_t i = 0; i < len; i++)
+	{
+		if (strchr(" \t\\'\"|&<>;()$`", name[i]))
+			*out++ = '\\';
+		*out++ = name[i];
+	}
+	*out = 0;
+	return escaped;
+}
+
+//finds the candidates for the word that ends at cursor
+//the first word of a command is a command name, the argument of shortdir jump/del is
+//an alias and anything else is a file; c->word_start is set to where the replaced part begins
+void complete_word(struct completion *c, const char *line, size_t cursor){
+	memset(c, 0, sizeof(*c));
+	// the word starts after the last unescaped separator
+	size_t start = 0;
+	bool escaped = false;
+	char quote = 0;
+	for (size_t i = 0; i < cursor; i++)
+	{
+		if (escaped)
+			escaped = false;
+		else if (quote)
+			quote = line[i] == quote ? 0 : quote;
+		else if (line[i] == '\\')
+			escaped = true;
+		else if (line[i] == '\'' || line[i] == '"')
+			quote = line[i];
+		else if (strchr(" \t|&<>;()", line[i]))
+			start = i + 1;
+	}
+	char *word = complete_unescape(line + start, cursor - start);
+
+	// the words of this command before the one being completed
+	size_t stage = start;
+	while (stage > 0 && !strchr("|&;(", line[stage - 1]))
+		stage--;
+	char *before = complete_unescape(line + stage, start - stage);
+	char *first_word = strtok(before, " \t");
+	char *second_word = first_word ? strtok(NULL, " \t") : NULL;
+	char *third_word = second_word ? strtok(NULL, " \t") : NULL;
+
+	const char *slash = strrchr(word, '/');
+	if (first_word == NULL && slash == NULL)
+		complete_commands(c, word);
+	else if (first_word && strcmp(first_word, "shortdir") == 0 && second_word && third_word == NULL &&
+			 (strcmp(second_word, "jump") == 0 || strcmp(second_word, "del") == 0))
+		complete_aliases(c, word);
+	else
+		complete_files(c, word);
+
+	// only the part after the last slash is replaced, the directory part stays as typed
+	c->word_start = start;
+	if (slash)
+	{
+		size_t slashes = 0;
+		for (const char *p = word; p <= slash; p++)
+			slashes += *p == '/';
+		for (size_t i = start; i < cursor && slashes > 0; i++)
+			if (line[i] == '/' && --slashes == 0)
+				c->word_start = i + 1;
+	}
+	free(word);
+	free(before);
+}
+
+//length of the prefix all candidates share
+size_t completion_common(struct completion *c){
+	size_t len = strlen(c->names[0]);
+	for (int i = 1; i < c->count; i++)
+	{
+		size_t j = 0;
+		while (j < len && c->names[i][j] == c->names[0][j])
+			j++;
+		len = j;
+	}
+	return len;
+}
+
+//prints the candidates in columns that fit the terminal
+void completion_list(struct completion *c, struct outbuf *out){
+	struct winsize ws;
+	int width = ioctl(STDOUT_FILENO, TIOCGWINSZ, &ws) == 0 && ws.ws_col > 0 ? ws.ws_col : 80;
+	int shown = c->count > 200 ? 200 : c->count;
+	size_t longest = 1;
+	for (int i = 0; i < shown; i++)
+		if (strlen(c->names[i]) > longest)
+			longest = strlen(c->names[i]);
+	int columns = width / (longest + 2);
+	if (columns < 1)
+		columns = 1;
+	int rows = (shown + columns - 1) / columns;
+	char cell[4096];
+	outbuf_put(out, "\r\n", 2);
+	for (int r = 0; r < rows; r++)
+	{
+		for (int col = 0; col < columns; col++)
+		{
+			int i = col * rows + r;
+			if (i >= shown)
+				continue;
+			int len = snprintf(cell, sizeof(cell), "%-*s", (int)(longest + 2), c->names[i]);
+			outbuf_put(out, cell, len < (int)sizeof(cell) ? len : (int)sizeof(cell) - 1);
+		}
+		outbuf_put(out, "\r\n", 2);
+	}
+	if (shown < c->count)
+		outbuf_put(out, cell, snprintf(cell, sizeof(cell), "... and %d more\r\n", c->count - shown));
+}
+//Tab: a single candidate is inserted whole, several are completed to the prefix they share
+//and listed below the line when that adds nothing
+void line_complete(struct line_editor *ed){
+	struct gap_buffer *g = &ed->line;
+	size_t cursor = g->gap_start;
+	char *text = gap_string(g);
+	struct completion c;
+	complete_word(&c, text, cursor);
+	if (c.count > 0)
+	{
+		char *typed = complete_unescape(text + c.word_start, cursor - c.word_start);
+		size_t common = completion_common(&c);
+		if (c.count == 1 || common > strlen(typed))
+		{
+			size_t len = c.count == 1 ? strlen(c.names[0]) : common;
+			char *insert = complete_escape(c.names[0], len);
+			gap_delete(g, c.word_start, cursor);
+			gap_insert(g, insert, strlen(insert));
+			if (c.count == 1 && c.names[0][len - 1] != '/')
+				gap_insert(g, " ", 1);
+			free(insert);
+			line_redraw(ed, false);
+		}
+		else
+		{
+			// the list goes below the last row of the line, the prompt is drawn again below it
+			line_cursor_move(ed, line_position(ed, ed->shown, ed->shown_cursor), line_position(ed, ed->shown, ed->shown_len));
+			completion_list(&c, &ed->out);
+			ed->shown_row = 0;
+			line_redraw(ed, true);
+		}
+		free(typed);
+	}
+	completion_free(&c);
+	free(text);
+}
+// COMPLETION HELPER METHODS END //
+
+
+// STATS HELPER METHODS START //
+
+//every command run in the session is measured: wall time with clock_gettime, and user/sys
+//time, max RSS, context switches and blocks read/written from the rusage wait4 returns
+//(getrusage deltas for builtins run inside the shell). stats prints p50/p99 per command
+//name, stats -j writes the records as JSON lines and $SEASHELL_STATS_FILE, when set,
+//gets every record appended as soon as the command finishes.
+//builtins run inside the shell or by a helper have no max RSS of their own, the peak of
+//that process covers everything it ran before, so they show - (null in JSON) instead.
+//block io is ru_inblock + ru_oublock in bytes: what went to or came from the disk, reads
+//served by the page cache and pipe or terminal traffic are not in it
+struct command_stat
+{
+	char *text;
+	char *name; // first word of text, records are grouped by it
+	time_t when;
+	double wall;
+	double user;
+	double sys;
+	long maxrss; // KB, 0 when unknown
+	long ctxsw;
+	long long block_io_bytes;
+	int status;
+};
+
+struct
+{
+	struct command_stat *records;
+	size_t count;
+	size_t cap;
+} stats_log;
+
+static double timeval_seconds(struct timeval tv){
+	return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+void stats_write_json(FILE *fp, struct command_stat *r){
+	fprintf(fp, "{\"when\":%lld,\"command\":\"", (long long)r->when);
+	for (const char *p = r->text; *p; p++)
+	{
+		if (*p == '"' || *p == '\\')
+			fprintf(fp, "\\%c", *p);
+		else if ((unsigned char)*p < 0x20)
+			fprintf(fp, "\\u%04x", *p);
+		else
+			fputc(*p, fp);
+	}
+	fprintf(fp, "\",\"status\":%d,\"wall\":%.6f,\"user\":%.6f,\"sys\":%.6f,\"maxrss_kb\":", r->status, r->wall, r->user,
+			r->sys);
+	if (r->maxrss > 0)
+		fprintf(fp, "%ld", r->maxrss);
+	else
+		fprintf(fp, "null");
+	fprintf(fp, ",\"ctxsw\":%ld,\"block_io_bytes\":%lld}\n", r->ctxsw, r->block_io_bytes);
+}
+
+//adds one finished command, started is its CLOCK_MONOTONIC start
+struct command_stat *stats_record(const char *text, struct timespec *started, struct rusage *ru, int status){
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	if (stats_log.count == stats_log.cap)
+	{
+		stats_log.cap = stats_log.cap ? stats_log.cap * 2 : 64;
+		stats_log.records = realloc(stats_log.records, sizeof(struct command_stat) * stats_log.cap);
+	}
+	struct command_stat *r = &stats_log.records[stats_log.count++];
+	r->text = strdup(text);
+	r->name = strndup(text, strcspn(text, " "));
+	r->wall = (now.tv_sec - started->tv_sec) + (now.tv_nsec - started->tv_nsec) / 1e9;
+	r->when = time(NULL) - (time_t)r->wall;
+	r->user = timeval_seconds(ru->ru_utime);
+	r->sys = timeval_seconds(ru->ru_stime);
+	r->maxrss = ru->ru_maxrss;
+	r->ctxsw = ru->ru_nvcsw + ru->ru_nivcsw;
+	r->block_io_bytes = (long long)(ru->ru_inblock + ru->ru_oublock) * 512;
+	r->status = status;
+
+	const char *export = getenv("SEASHELL_STATS_FILE");
+	if (export && *export)
+	{
+		FILE *fp = fopen(export, "ae");
+		if (fp)
+		{
+			stats_write_json(fp, r);
+			fclose(fp);
+		}
+	}
+	return r;
+}
+
+//what a process used between two getrusage calls, max RSS is left 0 because the peak
+//of the process can not be split between the calls
+void rusage_delta(struct rusage *delta, struct rusage *before, struct rusage *after){
+	memset(delta, 0, sizeof(*delta));
+	timersub(&after->ru_utime, &before->ru_utime, &delta->ru_utime);
+	timersub(&after->ru_stime, &before->ru_stime, &delta->ru_stime);
+	delta->ru_nvcsw = after->ru_nvcsw - before->ru_nvcsw;
+	delta->ru_nivcsw = after->ru_nivcsw - before->ru_nivcsw;
+	delta->ru_inblock = after->ru_inblock - before->ru_inblock;
+	delta->ru_oublock = after->ru_oublock - before->ru_oublock;
+}
+
+//runs a builtin inside the shell and records it with the rusage of the shell over the call
+int stats_run_builtin(struct command_t *command, int redirect_fds[2]){
+	struct timespec started;
+	struct rusage before, after, delta;
+	clock_gettime(CLOCK_MONOTONIC, &started);
+	getrusage(RUSAGE_SELF, &before);
+	int r = run_builtin_redirected(command, redirect_fds);
+	getrusage(RUSAGE_SELF, &after);
+	rusage_delta(&delta, &before, &after);
+	char *text = command_to_text(command);
+	stats_record(text, &started, &delta, last_status);
+	free(text);
+	return r;
+}
+
+size_t stats_count(){
+	return stats_log.count;
+}
+
+//the report of the time prefix, on stderr like bash, if the timed command left a record
+void stats_print_time(size_t recorded){
+	if (stats_log.count <= recorded)
+		return;
+	struct command_stat *r = &stats_log.records[stats_log.count - 1];
+	fflush(stdout);
+	char maxrss[32] = "-";
+	if (r->maxrss > 0)
+		snprintf(maxrss, sizeof(maxrss), "%ld KB", r->maxrss);
+	fprintf(stderr, "\nreal\t%.3fs\nuser\t%.3fs\nsys\t%.3fs\nmaxrss\t%s\nctxsw\t%ld\nblockio\t%lld bytes\n",
+			r->wall, r->user, r->sys, maxrss, r->ctxsw, r->block_io_bytes);
+}
+
+int stats_name_compare(const void *a, const void *b){
+	const struct command_stat *x = *(struct command_stat **)a, *y = *(struct command_stat **)b;
+	int cmp = strcmp(x->name, y->name);
+	return cmp ? cmp : (x->wall > y->wall) - (x->wall < y->wall);
+}
+
+int double_compare(const void *a, const void *b){
+	double x = *(double *)a, y = *(double *)b;
+	return (x > y) - (x < y);
+}
+
+//nearest-rank percentile of sorted values
+static double percentile(double *sorted, size_t n, int p){
+	size_t rank = (n * p + 99) / 100;
+	return sorted[rank > 0 ? rank - 1 : 0];
+}
+
+//stats: p50/p99 of wall and cpu time per command name, stats -j: JSON lines, stats -c: clear
+void stats_builtin(struct command_t *command){
+	if (command->arg_count > 0 && strcmp(command->args[0], "-c") == 0)
+	{
+		for (size_t i = 0; i < stats_log.count; i++)
+		{
+			free(stats_log.records[i].text);
+			free(stats_log.records[i].name);
+		}
+		stats_log.count = 0;
+		return;
+	}
+	if (command->arg_count > 0 && strcmp(command->args[0], "-j") == 0)
+	{
+		for (size_t i = 0; i < stats_log.count; i++)
+			stats_write_json(stdout, &stats_log.records[i]);
+		return;
+	}
+	if (stats_log.count == 0)
+	{
+		printf("No commands recorded\n");
+		return;
+	}
+
+	// records sorted by name and wall time, one line per name
+	struct command_stat **sorted = malloc(sizeof(struct command_stat *) * stats_log.count);
+	double *cpu = malloc(sizeof(double) * stats_log.count);
+	double *wall = malloc(sizeof(double) * stats_log.count);
+	for (size_t i = 0; i < stats_log.count; i++)
+		sorted[i] = &stats_log.records[i];
+	qsort(sorted, stats_log.count, sizeof(struct command_stat *), stats_name_compare);
+	printf("%-16s %6s %10s %10s %10s %10s %10s %12s\n", "COMMAND", "RUNS", "WALL p50", "WALL p99", "CPU p50", "CPU p99",
+		   "MAXRSS KB", "BLOCK IO B");
+	for (size_t i = 0; i < stats_log.count;)
+	{
+		size_t n = 0;
+		long maxrss = 0;
+		long long io = 0;
+		const char *name = sorted[i]->name;
+		for (; i < stats_log.count && strcmp(sorted[i]->name, name) == 0; i++, n++)
+		{
+			wall[n] = sorted[i]->wall;
+			cpu[n] = sorted[i]->user + sorted[i]->sys;
+			if (sorted[i]->maxrss > maxrss)
+				maxrss = sorted[i]->maxrss;
+			io += sorted[i]->block_io_bytes;
+		}
+		qsort(cpu, n, sizeof(double), double_compare);
+		char maxrss_text[32] = "-";
+		if (maxrss > 0)
+			snprintf(maxrss_text, sizeof(maxrss_text), "%ld", maxrss);
+		printf("%-16s %6zu %9.3fs %9.3fs %9.3fs %9.3fs %10s %12lld\n", name, n, percentile(wall, n, 50),
+			   percentile(wall, n, 99), percentile(cpu, n, 50), percentile(cpu, n, 99), maxrss_text, io);
+	}
+	free(sorted);
+	free(cpu);
+	free(wall);
+}
+// STATS HELPER METHODS END //
+
+
+// BENCHMARK HELPER METHODS START //
+
+//bench [-b baseline] [-u] [-p percent] [-t test,...] [size...]
+//runs the hot paths of the shell on generated inputs of every given size (64K, 16M, 1G, ...)
+//and prints operations and megabytes per second and heap allocations per operation.
+//the inputs come from a fixed seed so every run sees the same bytes. with -b the results
+//are compared against the baseline file and results slower by more than percent (10 by
+//default) or allocating more are flagged as regressions, the baseline is
+//written when it does not exist yet or -u is given.
+//allocations are only counted in a build with -DSEASHELL_BENCH on glibc (make bench),
+//where the malloc family below forwards to glibc and counts the calls of the thread
+//running the benchmark while bench_counting is set. other builds print - for them
+static __thread bool bench_counting;
+static __thread unsigned long bench_allocs;
+
+#if defined(SEASHELL_BENCH) && defined(__GLIBC__)
+#define BENCH_COUNTS_ALLOCS 1
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t count, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+extern void *__libc_memalign(size_t alignment, size_t size);
+extern void __libc_free(void *ptr);
+
+void *malloc(size_t size){
+	bench_allocs += bench_counting;
+	return __libc_malloc(size);
+}
+
+void *calloc(size_t count, size_t size){
+	bench_allocs += bench_counting;
+	return __libc_calloc(count, size);
+}
+
+void *realloc(void *ptr, size_t size){
+	bench_allocs += bench_counting;
+	return __libc_realloc(ptr, size);
+}
+
+void *memalign(size_t alignment, size_t size){
+	bench_allocs += bench_counting;
+	return __libc_memalign(alignment, size);
+}
+
+void *aligned_alloc(size_t alignment, size_t size){
+	bench_allocs += bench_counting;
+	return __libc_memalign(alignment, size);
+}
+
+int posix_memalign(void **ptr, size_t alignment, size_t size){
+	if (alignment % sizeof(void *) != 0 || (alignment & (alignment - 1)) != 0)
+		return EINVAL;
+	bench_allocs += bench_counting;
+	void *mem = __libc_memalign(alignment, size);
+	if (mem == NULL)
+		return ENOMEM;
+	*ptr = mem;
+	return 0;
+}
+
+void free(void *ptr){
+	__libc_free(ptr);
+}
+#else
+#define BENCH_COUNTS_ALLOCS 0
+#endif
+
+struct bench_context
+{
+	char dir[400];
+	size_t size;
+	char text1[450], text2[450];	   // text files differing in about 16 lines
+	char binary1[450], binary2[450]; // binary files differing in 16 bytes
+	char output[450];
+	char *lines; // NUL separated command lines for the parser
+	size_t line_count;
+	char **queries; // shortdir names and prefixes
+	size_t query_count;
+};
+
+struct bench_test
+{
+	const char *name;
+	void (*setup)(struct bench_context *ctx);
+	size_t (*run)(struct bench_context *ctx); // returns the operations done
+	void (*teardown)(struct bench_context *ctx);
+	bool per_byte; // throughput in MB/s of the input size
+};
+
+struct bench_result
+{
+	char name[64];
+	size_t size;
+	double ops_per_sec;
+	double mb_per_sec; // the whole input is processed by every run
+	double allocs_per_op;
+};
+
+static const char *bench_words[] = {
+	"ls", "grep", "sort", "error", "warning", "kernel", "shell", "file", "path", "process",
+	"thread", "signal", "pipe", "socket", "memory", "buffer", "seashell", "project", "build", "test",
+	"-la", "-n", "src", "include", "main.c", "log", "data", "cache", "index", "request", "user", "home",
+};
+#define BENCH_WORD_COUNT (sizeof(bench_words) / sizeof(bench_words[0]))
+
+static uint64_t bench_random(uint64_t *state){
+	*state ^= *state >> 12;
+	*state ^= *state << 25;
+	*state ^= *state >> 27;
+	return *state * 0x2545F4914F6CDD1DULL;
+}
+
+//appends a line of random words to buf and returns its length
+static size_t bench_line(uint64_t *state, char *buf){
+	size_t len = 0;
+	int words = 3 + bench_random(state) % 8;
+	for (int i = 0; i < words; i++)
+	{
+		const char *w = bench_words[bench_random(state) % BENCH_WORD_COUNT];
+		size_t n = strlen(w);
+		memcpy(buf + len, w, n);
+		len += n;
+		buf[len++] = i + 1 < words ? ' ' : '\n';
+	}
+	return len;
+}
+
+//writes two text files of the given size that differ in about 16 lines
+static void bench_write_text(const char *path1, const char *path2, size_t size){
+	int fd1 = open(path1, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+	int fd2 = open(path2, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+	struct outbuf out1 = {.fd = fd1}, out2 = {.fd = fd2};
+	uint64_t state = 0x5EA5E11;
+	size_t stride = size / 64 / 16 + 1, line = 0;
+	char buf[256];
+	for (size_t written = 0; written < size; line++)
+	{
+		size_t len = bench_line(&state, buf);
+		outbuf_put(&out1, buf, len);
+		if (line % stride == stride / 2)
+			len = bench_line(&state, buf);
+		outbuf_put(&out2, buf, len);
+		written += len;
+	}
+	outbuf_flush(&out1);
+	outbuf_flush(&out2);
+	free(out1.data);
+	free(out2.data);
+	close(fd1);
+	close(fd2);
+}
+
+//writes two random binary files of the given size that differ in 16 bytes
+static void bench_write_binary(const char *path1, const char *path2, size_t size){
+	int fd1 = open(path1, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+	int fd2 = open(path2, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+	uint64_t state = 0xB1AB1;
+	size_t chunk = 1 << 20;
+	uint64_t *buf = malloc(chunk);
+	for (size_t offset = 0; offset < size; offset += chunk)
+	{
+		size_t len = size - offset < chunk ? size - offset : chunk;
+		for (size_t i = 0; i < (len + 7) / 8; i++)
+			buf[i] = bench_random(&state);
+		write_all(fd1, (char *)buf, len);
+		for (size_t k = 0; k < 16; k++)
+		{
+			size_t at = k * (size / 16) + 7;
+			if (at >= offset && at < offset + len)
+				((unsigned char *)buf)[at - offset] ^= 0x5A;
+		}
+		write_all(fd2, (char *)buf, len);
+	}
+	free(buf);
+	close(fd1);
+	close(fd2);
+}
+
+static void bench_setup_text(struct bench_context *ctx){
+	bench_write_text(ctx->text1, ctx->text2, ctx->size);
+}
+
+static void bench_setup_binary(struct bench_context *ctx){
+	bench_write_binary(ctx->binary1, ctx->binary2, ctx->size);
+}
+
+static void bench_teardown_files(struct bench_context *ctx){
+	unlink(ctx->text1);
+	unlink(ctx->text2);
+	unlink(ctx->binary1);
+	unlink(ctx->binary2);
+	unlink(ctx->output);
+}
+
+static void bench_setup_parse(struct bench_context *ctx){
+	uint64_t state = 0xC0FFEE;
+	ctx->lines = malloc(ctx->size + 256);
+	ctx->line_count = 0;
+	for (size_t len = 0; len < ctx->size; ctx->line_count++)
+	{
+		size_t n = bench_line(&state, ctx->lines + len);
+		if (ctx->line_count % 4 == 1)
+			memcpy(ctx->lines + len + n - 1, " | wc", 5), n += 4; // some pipelines too
+		ctx->lines[len + n - 1] = 0;
+		len += n;
+	}
+}
+
+static size_t bench_run_parse(struct bench_context *ctx){
+	struct command_t command;
+	char *line = ctx->lines;
+	for (size_t i = 0; i < ctx->line_count; i++)
+	{
+		memset(&command, 0, sizeof(command));
+		parse_command(line, &command);
+		arena_release(command.arena);
+		line += strlen(line) + 1;
+	}
+	return ctx->line_count;
+}
+
+static void bench_teardown_parse(struct bench_context *ctx){
+	free(ctx->lines);
+	ctx->lines = NULL;
+}
+
+static size_t bench_run_highlight(struct bench_context *ctx){
+	highlight("error", "r", ctx->text1);
+	return 1;
+}
+
+static size_t bench_run_compare_txt(struct bench_context *ctx){
+	unlink(kdiff_cache_path); // the digests must be computed every time
+	compare_txt_files(ctx->text1, ctx->text2, DIFF_MYERS, 3);
+	return 1;
+}
+
+static size_t bench_run_compare_binary(struct bench_context *ctx){
+	unlink(kdiff_cache_path);
+	compare_binary_files(ctx->binary1, ctx->binary2, false);
+	return 1;
+}
+
+static size_t bench_run_concatenate(struct bench_context *ctx){
+	char *argv[] = {"-t", ctx->output, ctx->text1, ctx->binary1};
+	concatenate_txt_files(4, argv);
+	return 1;
+}
+
+static void bench_setup_concatenate(struct bench_context *ctx){
+	// half of the size from each kind of input
+	size_t size = ctx->size;
+	ctx->size = size / 2;
+	bench_setup_text(ctx);
+	bench_setup_binary(ctx);
+	ctx->size = size;
+}
+
+//the aliases and visits of the shortdir bench live in their own journal, the
+//store of the session is put aside meanwhile
+struct shortdir_store bench_saved_shortdir;
+char bench_saved_db_path[sizeof(shortdir_db_path)];
+
+static void bench_setup_shortdir(struct bench_context *ctx){
+	size_t count = ctx->size / 256;
+	count = count < 16 ? 16 : count > (1 << 20) ? (1 << 20) : count;
+	bench_saved_shortdir = shortdir;
+	memset(&shortdir, 0, sizeof(shortdir));
+	strcpy(bench_saved_db_path, shortdir_db_path);
+	snprintf(shortdir_db_path, sizeof(shortdir_db_path), "%s/shortdir.db", ctx->dir);
+
+	FILE *fp = fopen(shortdir_db_path, "we");
+	uint64_t state = 0xD1D1;
+	ctx->query_count = count < 4096 ? count : 4096;
+	ctx->queries = malloc(sizeof(char *) * ctx->query_count);
+	for (size_t i = 0; i < count; i++)
+	{
+		const char *word = bench_words[bench_random(&state) % BENCH_WORD_COUNT];
+		unsigned long tag = bench_random(&state) & 0xFFFFFF;
+		fprintf(fp, "S\t%s%lu\t/bench/%s/alias%zu\n", word, tag, word, i);
+		fprintf(fp, "R\t%.3f\t%lld\t/bench/%s/%06lx\n", (double)(bench_random(&state) % 100 + 1),
+				(long long)time(NULL), word, tag);
+		// exact aliases and the prefixes of directory names
+		if (i < ctx->query_count)
+		{
+			char query[64];
+			if (i % 4 == 3)
+				snprintf(query, sizeof(query), "%06lx", tag);
+			else
+				snprintf(query, sizeof(query), "%s%lu", word, tag);
+			ctx->queries[i] = strdup(query);
+		}
+	}
+	fclose(fp);
+	shortdir_find(ctx->queries[3]); // a prefix query loads the journal and builds the index
+}
+
+static size_t bench_run_shortdir(struct bench_context *ctx){
+	for (size_t i = 0; i < 100000; i++)
+		shortdir_find(ctx->queries[i % ctx->query_count]);
+	return 100000;
+}
 
-   for(int i=0;i<=strlen(new_word);i++){
-      if(new_word[i]>=65&&new_word[i]<=90){
-         new_word[i]=new_word[i]+32;
-      }
-   }
-   return new_word;
+static void bench_teardown_shortdir(struct bench_context *ctx){
+	shortdir_apply_clear();
+	shortdir_visits_clear();
+	for (size_t i = 0; i < shortdir.index_count; i++)
+		free(shortdir.index[i].key);
+	free(shortdir.index);
+	free(shortdir.by_name);
+	free(shortdir.by_path);
+	free(shortdir.visits);
+	shortdir = bench_saved_shortdir;
+	strcpy(shortdir_db_path, bench_saved_db_path);
+	for (size_t i = 0; i < ctx->query_count; i++)
+		free(ctx->queries[i]);
+	free(ctx->queries);
+	unlink(ctx->output);
+	char path[450];
+	snprintf(path, sizeof(path), "%s/shortdir.db", ctx->dir);
+	unlink(path);
 }
 
-//displaying colored text r, g or b
-void print_colored_text(char *color, char*text){
-   if (strcmp(color, "r") == 0){
-      printf("\033[;31m%s \033[0m",text);
-   }else if(strcmp(color, "b") == 0){
-      printf("\033[;34m%s \033[0m",text);
-   }else if(strcmp(color, "g") == 0){
-      printf("\033[;32m%s \033[0m",text);
-   }
-} 
+struct bench_test bench_tests[] = {
+	{"parse", bench_setup_parse, bench_run_parse, bench_teardown_parse, true},
+	{"highlight", bench_setup_text, bench_run_highlight, bench_teardown_files, true},
+	{"compare_txt", bench_setup_text, bench_run_compare_txt, bench_teardown_files, true},
+	{"compare_binary", bench_setup_binary, bench_run_compare_binary, bench_teardown_files, true},
+	{"concatenate", bench_setup_concatenate, bench_run_concatenate, bench_teardown_files, true},
+	{"shortdir", bench_setup_shortdir, bench_run_shortdir, bench_teardown_shortdir, false},
+};
 
-//the main method of the question3
-//takes a word, color char and file_name. Changes the color of every occurence of the given word in given file.
-void highlight(char *word, char* color, char* file_name){
-   char* lowered_word = to_lower_case(word);
-   
-   FILE *txt_file;
-   txt_file = fopen(file_name, "r");
-
-   char line[256];
-   char word_in_line[50];
-   
-   int i;
-   int j = 0;
-
-   while(fgets(line, sizeof(line), txt_file)!=NULL){
-      for (i=0; i<strlen(line); i++){
-         if(line[i]== ' ' || line[i]=='\0' || line[i]=='\n'){
-            word_in_line[j] = '\0';
-            if(strcmp(lowered_word, to_lower_case(word_in_line))==0){
-               print_colored_text(color, word_in_line);
-            }else{
-               printf("%s ", word_in_line);
-            }
-            j=0;
-         }
-         else{
-            word_in_line[j] = line[i];
-            j++;
-         }
-      }
-      printf("\n");
-   }
-   fclose(txt_file);
+//parses 64K, 16M, 1G or a plain byte count
+size_t bench_parse_size(const char *str){
+	char *end;
+	double value = strtod(str, &end);
+	if (end == str || value <= 0)
+		return 0;
+	switch (*end)
+	{
+	case 'k': case 'K': value *= 1 << 10; break;
+	case 'm': case 'M': value *= 1 << 20; break;
+	case 'g': case 'G': value *= 1 << 30; break;
+	}
+	return (size_t)value;
 }
 
-// QUESTION 3 HELPER METHODS END //
+void bench_format_size(size_t size, char *out, size_t out_size){
+	if (size >= 1 << 30 && size % (1 << 30) == 0)
+		snprintf(out, out_size, "%zuG", size >> 30);
+	else if (size >= 1 << 20 && size % (1 << 20) == 0)
+		snprintf(out, out_size, "%zuM", size >> 20);
+	else if (size >= 1 << 10 && size % (1 << 10) == 0)
+		snprintf(out, out_size, "%zuK", size >> 10);
+	else
+		snprintf(out, out_size, "%zu", size);
+}
 
+//runs a test until half a second has passed and keeps its fastest run
+//the output of the builtins goes to /dev/null meanwhile
+void bench_measure(struct bench_test *test, struct bench_context *ctx, struct bench_result *result){
+	int null_fd = open("/dev/null", O_WRONLY | O_CLOEXEC);
+	fflush(stdout);
+	int saved_stdout = dup(STDOUT_FILENO);
+	dup2(null_fd, STDOUT_FILENO);
+	close(null_fd);
 
-// QUESTION 5 HELPER METHODS START //
+	double best = -1, total = 0;
+	unsigned long allocs = 0;
+	size_t ops = 0, best_ops = 0;
+	for (int runs = 0; total < 0.5 || runs < 2; runs++)
+	{
+		struct timespec start, end;
+		unsigned long allocs_before = bench_allocs;
+		bench_counting = true;
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		size_t n = test->run(ctx);
+		clock_gettime(CLOCK_MONOTONIC, &end);
+		bench_counting = false;
+		fflush(stdout);
 
-//takes two files in .txt format and displays the different lines.
-void compare_txt_files(char *txt1, char *txt2){
-   FILE *txt1_file, *txt2_file;
-   int l1 = strlen(txt1);
-   int l2 = strlen(txt2);
+		double seconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+		total += seconds;
+		allocs += bench_allocs - allocs_before;
+		ops += n;
+		if (best < 0 || seconds / n < best / best_ops)
+		{
+			best = seconds;
+			best_ops = n;
+		}
+		if (total > 10)
+			break; // GB inputs, one more run says little
+	}
+	dup2(saved_stdout, STDOUT_FILENO);
+	close(saved_stdout);
 
-   if(l1<4 || txt1[l1-4]!='.' || txt1[l1-3]!='t' || txt1[l1-2]!='x' || txt1[l1-1]!='t' || 
-   l2<4 || txt2[l2-4]!='.' || txt2[l2-3]!='t' || txt2[l2-2]!='x' || txt2[l2-1]!='t'){
-      printf("File should be in txt format\n");
-      return;
-   }
+	snprintf(result->name, sizeof(result->name), "%s", test->name);
+	result->size = ctx->size;
+	result->ops_per_sec = best_ops / (best > 0 ? best : 1e-9);
+	result->mb_per_sec = ctx->size / 1048576.0 / (best > 0 ? best : 1e-9);
+	result->allocs_per_op = BENCH_COUNTS_ALLOCS ? (double)allocs / ops : -1;
+}
+
+//reads "name size ops_per_sec allocs_per_op" lines
+size_t bench_load_baseline(const char *path, struct bench_result **results){
+	FILE *fp = fopen(path, "re");
+	size_t count = 0, cap = 0;
+	*results = NULL;
+	if (fp == NULL)
+		return 0;
+	struct bench_result r;
+	while (fscanf(fp, "%63s %zu %lf %lf", r.name, &r.size, &r.ops_per_sec, &r.allocs_per_op) == 4)
+	{
+		if (count == cap)
+		{
+			cap = cap ? cap * 2 : 32;
+			*results = realloc(*results, sizeof(struct bench_result) * cap);
+		}
+		(*results)[count++] = r;
+	}
+	fclose(fp);
+	return count;
+}
 
-   txt1_file = fopen(txt1, "r");
-   txt2_file = fopen(txt2, "r");
+void bench_builtin(struct command_t *command){
+	const char *baseline_path = NULL, *only = NULL;
+	bool update = false;
+	double tolerance = 10;
+	size_t sizes[32], size_count = 0;
+	for (int i = 0; i < command->arg_count; i++)
+	{
+		if (strcmp(command->args[i], "-b") == 0 && i + 1 < command->arg_count)
+			baseline_path = command->args[++i];
+		else if (strcmp(command->args[i], "-t") == 0 && i + 1 < command->arg_count)
+			only = command->args[++i];
+		else if (strcmp(command->args[i], "-p") == 0 && i + 1 < command->arg_count)
+			tolerance = atof(command->args[++i]);
+		else if (strcmp(command->args[i], "-u") == 0)
+			update = true;
+		else if (size_count < 32 && (sizes[size_count] = bench_parse_size(command->args[i])) > 0)
+			size_count++;
+		else
+		{
+			printf("-%s: bench: bad size %s\n", sysname, command->args[i]);
+			return;
+		}
+	}
+	if (size_count == 0)
+	{
+		sizes[size_count++] = 64 << 10;
+		sizes[size_count++] = 16 << 20;
+	}
 
-   if(txt1_file==NULL || txt2_file==NULL){
-      printf("Problem with the file format");
-      return;
-   }
+	struct bench_context ctx;
+	memset(&ctx, 0, sizeof(ctx));
+	const char *tmp = getenv("TMPDIR") ? getenv("TMPDIR") : "/tmp";
+	snprintf(ctx.dir, sizeof(ctx.dir), "%s/seashell-bench.XXXXXX", tmp);
+	if (mkdtemp(ctx.dir) == NULL)
+	{
+		printf("-%s: bench: %s: %s\n", sysname, ctx.dir, strerror(errno));
+		return;
+	}
+	snprintf(ctx.text1, sizeof(ctx.text1), "%s/text1.txt", ctx.dir);
+	snprintf(ctx.text2, sizeof(ctx.text2), "%s/text2.txt", ctx.dir);
+	snprintf(ctx.binary1, sizeof(ctx.binary1), "%s/binary1", ctx.dir);
+	snprintf(ctx.binary2, sizeof(ctx.binary2), "%s/binary2", ctx.dir);
+	snprintf(ctx.output, sizeof(ctx.output), "%s/output", ctx.dir);
+	char saved_cache_path[sizeof(kdiff_cache_path)];
+	strcpy(saved_cache_path, kdiff_cache_path);
+	snprintf(kdiff_cache_path, sizeof(kdiff_cache_path), "%s/kdiff.cache", ctx.dir);
 
-   char txt1_line[100], txt2_line[100];
-   
-   int line_number = 1;
-   int mismatch = 0;
-
-   int checker1 = 0;
-   int checker2 = 0;
-
-   while(1){
-      if(fgets(txt1_line, sizeof(txt1_line), txt1_file)==NULL) checker1++;
-      if(fgets(txt2_line, sizeof(txt2_line), txt2_file)==NULL) checker2++;
-      if(checker1!=0 && checker2!=0){
-         break;
-      }
-      if(checker1 != 0) strcpy(txt1_line, "\n");
-      if(checker2 != 0) strcpy(txt2_line, "\n");
-
-      if(txt1_line[strlen(txt1_line)-1] != '\n') strcat(txt1_line, "\n");
-      if(txt2_line[strlen(txt2_line)-1] != '\n') strcat(txt2_line, "\n");
-
-      if(strcmp(txt1_line, txt2_line)!=0){
-         mismatch++;
-         printf("%s:Line %d: %s",txt1, line_number, txt1_line);
-         printf("%s:Line %d: %s",txt2, line_number, txt2_line);
-      }
-      line_number++;
-   }
-   fclose(txt1_file);
-   fclose(txt2_file);
-   if(mismatch==0){
-      printf("The two files are identical\n");
-   }else{
-      printf("%d different lines found\n", mismatch);
-   }
+	struct bench_result *baseline = NULL;
+	size_t baseline_count = baseline_path ? bench_load_baseline(baseline_path, &baseline) : 0;
+	size_t test_count = sizeof(bench_tests) / sizeof(bench_tests[0]);
+	struct bench_result *results = malloc(sizeof(struct bench_result) * test_count * size_count);
+	size_t result_count = 0, regressions = 0;
+
+	printf("%-16s %6s %12s %10s %10s\n", "BENCH", "SIZE", "OPS/S", "MB/S", "ALLOCS/OP");
+	for (size_t s = 0; s < size_count; s++)
+	{
+		for (size_t t = 0; t < test_count; t++)
+		{
+			struct bench_test *test = &bench_tests[t];
+			if (only && strstr(only, test->name) == NULL)
+				continue;
+			ctx.size = sizes[s];
+			test->setup(&ctx);
+			struct bench_result *r = &results[result_count++];
+			bench_measure(test, &ctx, r);
+			test->teardown(&ctx);
+
+			char size_text[32], mbps[32] = "-";
+			bench_format_size(r->size, size_text, sizeof(size_text));
+			if (test->per_byte)
+				snprintf(mbps, sizeof(mbps), "%.1f", r->mb_per_sec);
+			char allocs[32] = "-";
+			if (r->allocs_per_op >= 0)
+				snprintf(allocs, sizeof(allocs), "%.1f", r->allocs_per_op);
+			printf("%-16s %6s %12.1f %10s %10s", r->name, size_text, r->ops_per_sec, mbps, allocs);
+
+			for (size_t b = 0; b < baseline_count; b++)
+			{
+				if (strcmp(baseline[b].name, r->name) != 0 || baseline[b].size != r->size)
+					continue;
+				double change = (r->ops_per_sec / baseline[b].ops_per_sec - 1) * 100;
+				// allocations are compared when both runs counted them
+				bool more_allocs = r->allocs_per_op >= 0 && baseline[b].allocs_per_op >= 0 &&
+								   r->allocs_per_op > baseline[b].allocs_per_op * 1.05 + 0.5;
+				printf("  %+.0f%%", change);
+				if (change < -tolerance || more_allocs)
+				{
+					printf("  REGRESSION");
+					if (more_allocs)
+						printf(" (%.1f allocs/op before)", baseline[b].allocs_per_op);
+					regressions++;
+				}
+				break;
+			}
+			printf("\n");
+			fflush(stdout);
+		}
+	}
+
+	if (baseline_path && (update || baseline_count == 0))
+	{
+		FILE *fp = fopen(baseline_path, "we");
+		if (fp == NULL)
+			printf("-%s: bench: %s: %s\n", sysname, baseline_path, strerror(errno));
+		else
+		{
+			for (size_t i = 0; i < result_count; i++)
+				fprintf(fp, "%s %zu %.1f %.2f\n", results[i].name, results[i].size, results[i].ops_per_sec,
+						results[i].allocs_per_op);
+			fclose(fp);
+			printf("baseline saved to %s\n", baseline_path);
+		}
+	}
+	else if (baseline_count > 0)
+		printf("%zu regressions against %s\n", regressions, baseline_path);
+	last_status = regressions > 0;
+
+	strcpy(kdiff_cache_path, saved_cache_path);
+	rmdir(ctx.dir);
+	free(results);
+	free(baseline);
 }
+// BENCHMARK HELPER METHODS END //
 
-//takes two files in any format and compares them byte by byte
-void compare_binary_files(char *file1_name, char *file2_name){
-    FILE *file1, *file2;
-    long size1, size2;  
-    char tmp1, tmp2;
 
-    file1 = fopen(file1_name,"r");
-    file2 = fopen(file2_name,"r");
+// PARALLEL HELPER METHODS START //
 
-   if(file1==NULL || file2==NULL){
-      printf("Problem with the file format");
-      return;
-   }
+//parallel [-j N] [-x] command [args...] [::: arg...]
+//runs command once for every argument after ::: (or every line of stdin), at most N at a
+//time where N is the number of cores by default. {} in the arguments is replaced by the
+//argument, without {} it is appended. jobs are started with launch_stage like the stages
+//of a pipeline, stdin is /dev/null and stdout a pipe read into a buffer per job: the
+//oldest unfinished job is written through, the others wait in their buffers for their
+//turn so the output is the same as a serial run. children are reaped when SIGCHLD writes
+//to the self-pipe and their slots refilled. with -x (and after a ^C) no job is started
+//once one failed, the status is the one of the first failed job
+struct parallel_job
+{
+	pid_t pid;	// -1 once reaped
+	int out_fd; // read end of the output pipe, -1 at end of file
+	struct outbuf out;
+	int status;
+	struct timespec started;
+	char *text;
+};
 
-    fseek (file1 , 0 , SEEK_END);
-    size1 = ftell (file1);
-    rewind (file1);
+//arguments read from stdin, one per line
+struct parallel_input
+{
+	char *buf;
+	size_t len;
+	size_t cap;
+	size_t pos;
+	bool eof;
+};
 
-    fseek (file2 , 0 , SEEK_END);
-    size2 = ftell (file2);
-    rewind (file2);
+//returns the next line of stdin without its newline, NULL at end of file
+char *parallel_next_line(struct parallel_input *in){
+	while (1)
+	{
+		char *nl = memchr(in->buf + in->pos, '\n', in->len - in->pos);
+		if (nl || (in->eof && in->pos < in->len))
+		{
+			size_t end = nl ? (size_t)(nl - in->buf) : in->len;
+			char *line = strndup(in->buf + in->pos, end - in->pos);
+			in->pos = nl ? end + 1 : end;
+			return line;
+		}
+		if (in->eof)
+			return NULL;
+		memmove(in->buf, in->buf + in->pos, in->len - in->pos);
+		in->len -= in->pos;
+		in->pos = 0;
+		if (in->len == in->cap)
+		{
+			in->cap = in->cap ? in->cap * 2 : 4096;
+			in->buf = realloc(in->buf, in->cap);
+		}
+		ssize_t n = read(STDIN_FILENO, in->buf + in->len, in->cap - in->len);
+		if (n == -1 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			in->eof = true;
+		else
+			in->len += n;
+	}
+}
 
-   int i=0;
-   int difference_counter = 0;
+//replaces every {} in word by arg, the result has to be freed
+char *parallel_substitute(const char *word, const char *arg, bool *used){
+	size_t arg_len = strlen(arg), len = 0;
+	for (const char *p = word; *p; p++)
+		len += p[0] == '{' && p[1] == '}' ? arg_len : 1;
+	char *out = malloc(len + 1), *o = out;
+	for (const char *p = word; *p; p++)
+	{
+		if (p[0] == '{' && p[1] == '}')
+		{
+			memcpy(o, arg, arg_len);
+			o += arg_len;
+			p++;
+			*used = true;
+		}
+		else
+			*o++ = *p;
+	}
+	*o = 0;
+	return out;
+}
 
-   for (i=0;i<size1;i++) {
-      fread(&tmp1, 1, 1, file1);
-      fread(&tmp2, 1, 1, file2);
-      if (tmp1 != tmp2) {
-         difference_counter += 1;
-      }
-   }
+//starts words with arg filled in, the job's stdout goes to a pipe
+void parallel_start(struct parallel_job *job, char **words, int word_count, const char *arg, int null_fd){
+	struct command_t c;
+	memset(&c, 0, sizeof(c));
+	char **argv = malloc(sizeof(char *) * (word_count + 2));
+	bool used = false;
+	for (int i = 0; i < word_count; i++)
+		argv[i] = parallel_substitute(words[i], arg, &used);
+	int argc = word_count;
+	if (!used)
+		argv[argc++] = strdup(arg);
+	c.name = argv[0];
+	c.args = argv + 1;
+	c.arg_count = argc - 1;
 
-   int length_diff = size1-size2;
-   if (length_diff<0){
-	   length_diff = length_diff *-1;
-   }
-   difference_counter = difference_counter + length_diff;
+	memset(job, 0, sizeof(*job));
+	job->text = command_to_text(&c);
+	job->out.cap = 4096;
+	job->out.data = malloc(job->out.cap);
+	job->out.fd = -1;
+	job->pid = -1;
+	job->out_fd = -1;
+	job->status = 127;
+	clock_gettime(CLOCK_MONOTONIC, &job->started);
 
-   if (difference_counter==0){
-      printf("The two files are identical\n");
-   }else{
-      printf("The two files are different in %d bytes\n", difference_counter);
-   }
+	int fds[2];
+	if (pipe2(fds, O_CLOEXEC) == -1)
+		printf("-%s: pipe: %s\n", sysname, strerror(errno));
+	else
+	{
+		job->pid = launch_stage(&c, null_fd, fds[1], -1);
+		close(fds[1]);
+		if (job->pid > 0)
+			job->out_fd = fds[0];
+		else
+			close(fds[0]);
+	}
+	for (int i = 0; i < argc; i++)
+		free(argv[i]);
+	free(argv);
 }
-// QUESTION 5 HELPER METHODS END //
 
+int parallel_builtin(struct command_t *command){
+	int max_jobs = sysconf(_SC_NPROCESSORS_ONLN);
+	bool halt = false;
+	int first = 0;
+	for (; first < command->arg_count && command->args[first][0] == '-'; first++)
+	{
+		const char *opt = command->args[first];
+		if (strcmp(opt, "-x") == 0)
+			halt = true;
+		else if (strncmp(opt, "-j", 2) == 0 && (opt[2] || first + 1 < command->arg_count))
+			max_jobs = atoi(opt[2] ? opt + 2 : command->args[++first]);
+		else
+			break;
+	}
+	// the command ends at ::: when the arguments are given on the line
+	int word_count = 0;
+	while (first + word_count < command->arg_count && strcmp(command->args[first + word_count], ":::") != 0)
+		word_count++;
+	char **words = command->args + first;
+	int list_index = first + word_count + 1;
+	bool from_stdin = list_index > command->arg_count;
+	if (word_count == 0 || max_jobs < 1)
+	{
+		printf("usage: parallel [-j N] [-x] command [args...] [::: arg...]\n");
+		return SUCCESS;
+	}
 
-// QUESTION 6 HELPER METHOD START //
+	// a private self-pipe, the builtin may run in a forked child where SIGCHLD was reset
+	int saved_pipe[2] = {sigchld_pipe[0], sigchld_pipe[1]};
+	struct sigaction sa, saved_sa;
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = sigchld_handler;
+	sa.sa_flags = SA_RESTART;
+	sigemptyset(&sa.sa_mask);
+	int private_pipe[2];
+	if (pipe2(private_pipe, O_CLOEXEC | O_NONBLOCK) == -1)
+	{
+		printf("-%s: pipe: %s\n", sysname, strerror(errno));
+		return SUCCESS;
+	}
+	// the handler must never see a half swapped pipe
+	sigset_t chld_set, saved_mask;
+	sigemptyset(&chld_set);
+	sigaddset(&chld_set, SIGCHLD);
+	sigprocmask(SIG_BLOCK, &chld_set, &saved_mask);
+	sigchld_pipe[0] = private_pipe[0], sigchld_pipe[1] = private_pipe[1];
+	sigaction(SIGCHLD, &sa, &saved_sa);
+	sigprocmask(SIG_SETMASK, &saved_mask, NULL);
 
-// # of arguments = 1....n where n>=2
-// All arguments need to be in the .txt format.
-// Starting from the second .txt file all .txt files are concatenated one by one.
-// The resulting concatenated .txt file is saved with the name given in the first argument.
-void concatenate_txt_files(int argc, char *argv[]){
-   if(argc<2){
-      printf("Bad format there should be at least 2 arguments. %d is given\n", argc);
-      return;
-   }
-   
-   int l;
-   int i;
-   for (i=0; i<argc; i++){
-      l = strlen(argv[i]);
-      if(l<4 || argv[i][l-4]!='.' || argv[i][l-3]!='t' || argv[i][l-2]!='x' || argv[i][l-1]!='t'){
-         printf("All files should be in txt format\n");
-         return;
-      }
-   }
+	int null_fd = open("/dev/null", O_RDONLY | O_CLOEXEC);
+	struct parallel_input input;
+	memset(&input, 0, sizeof(input));
+	struct parallel_job *jobs = NULL;
+	size_t job_count = 0, job_cap = 0, printed = 0;
+	struct pollfd *fds = NULL;
+	struct parallel_job **polled = NULL;
+	int running = 0, failed_status = 0;
+	bool stopped = false, more = true;
+	fflush(stdout);
+
+	while (1)
+	{
+		// fill the free slots
+		while (more && !stopped && running < max_jobs)
+		{
+			char *arg = from_stdin ? parallel_next_line(&input)
+								   : list_index < command->arg_count ? strdup(command->args[list_index++]) : NULL;
+			if (arg == NULL)
+			{
+				more = false;
+				break;
+			}
+			if (job_count == job_cap)
+			{
+				job_cap = job_cap ? job_cap * 2 : 64;
+				jobs = realloc(jobs, sizeof(struct parallel_job) * job_cap);
+				// a reaped job may still be writing, so any started job can have its pipe open
+				fds = realloc(fds, sizeof(struct pollfd) * (job_cap + 1 + helper_count()));
+				polled = realloc(polled, sizeof(struct parallel_job *) * job_cap);
+			}
+			struct parallel_job *job = &jobs[job_count++];
+			parallel_start(job, words, word_count, arg, null_fd);
+			free(arg);
+			if (job->pid > 0)
+				running++;
+			else if (failed_status == 0)
+			{
+				failed_status = 127;
+				stopped = halt;
+			}
+		}
 
-   FILE *output_txt, *input_txt;
-   output_txt = fopen(argv[0], "a+");
-   char line[256];
+		// print the finished jobs at the head of the queue, the next one is written through
+		while (printed < job_count && jobs[printed].pid == -1 && jobs[printed].out_fd == -1)
+		{
+			struct parallel_job *job = &jobs[printed++];
+			job->out.fd = STDOUT_FILENO;
+			outbuf_flush(&job->out);
+			free(job->out.data);
+			free(job->text);
+		}
+		if (printed < job_count)
+		{
+			jobs[printed].out.fd = STDOUT_FILENO;
+			outbuf_flush(&jobs[printed].out);
+		}
+		if (printed == job_count && (!more || stopped))
+			break;
 
-   for(i=1; i<argc;i++){
-      input_txt = fopen(argv[i], "r");
-      while(fgets(line, sizeof(line), input_txt)!=NULL){
-         fputs(line, output_txt);
-      }
-      fclose(input_txt);
-   }
-   fclose(output_txt);
+		int nfds = 0;
+		fds[nfds++] = (struct pollfd){.fd = sigchld_pipe[0], .events = POLLIN};
+		for (size_t i = printed; i < job_count; i++)
+		{
+			if (jobs[i].out_fd == -1)
+				continue;
+			polled[nfds - 1] = &jobs[i];
+			fds[nfds++] = (struct pollfd){.fd = jobs[i].out_fd, .events = POLLIN};
+		}
+		int output_fds = nfds;
+		nfds += helper_poll_fds(fds + nfds); // builtins run by helpers end with an answer
+		if (poll(fds, nfds, -1) == -1)
+		{
+			if (errno == EINTR)
+				continue;
+			break;
+		}
+
+		for (int i = 1; i < output_fds; i++)
+		{
+			if (fds[i].revents == 0)
+				continue;
+			struct parallel_job *job = polled[i - 1];
+			char buf[65536];
+			ssize_t n = read(job->out_fd, buf, sizeof(buf));
+			if (n > 0)
+			{
+				outbuf_put(&job->out, buf, n);
+				outbuf_flush(&job->out); // only writes for the job at the head
+			}
+			else if (n == 0 || errno != EINTR)
+			{
+				close(job->out_fd);
+				job->out_fd = -1;
+			}
+		}
+
+		char drain[64];
+		while (read(sigchld_pipe[0], drain, sizeof(drain)) > 0)
+			;
+		// only the jobs started here are waited for, the shell's own jobs keep their
+		// children until reap_children, only a helper answer may belong to one of them
+		while (1)
+		{
+			struct parallel_job *job = NULL;
+			int status;
+			struct rusage ru;
+			pid_t pid = helper_reap(&status, &ru);
+			for (size_t i = printed; i < job_count && job == NULL; i++)
+				if (jobs[i].pid > 0 && (pid > 0 ? jobs[i].pid == pid :
+								 wait4(jobs[i].pid, &status, WNOHANG | WUNTRACED | WCONTINUED, &ru) > 0))
+					job = &jobs[i];
+			if (pid > 0 && job == NULL)
+			{
+				job_update(pid, status, &ru); // a background job of the shell
+				continue;
+			}
+			if (job == NULL)
+				break;
+			if (WIFSTOPPED(status) || WIFCONTINUED(status))
+				continue;
+			job->pid = -1;
+			job->status = WIFSIGNALED(status) ? 128 + WTERMSIG(status) : WEXITSTATUS(status);
+			running--;
+			stats_record(job->text, &job->started, &ru, job->status);
+			if (job->status != 0 && failed_status == 0)
+				failed_status = job->status;
+			if (job->status != 0 && (halt || job->status == 128 + SIGINT))
+				stopped = true;
+		}
+	}
+
+	if (stopped && more)
+		printf("-%s: parallel: a job failed, no more jobs started\n", sysname);
+	last_status = failed_status;
+	free(fds);
+	free(polled);
+	free(jobs);
+	free(input.buf);
+	close(null_fd);
+
+	// put the shell's pipe and handler back before the private pipe goes away
+	sigprocmask(SIG_BLOCK, &chld_set, &saved_mask);
+	sigaction(SIGCHLD, &saved_sa, NULL);
+	sigchld_pipe[0] = saved_pipe[0], sigchld_pipe[1] = saved_pipe[1];
+	sigprocmask(SIG_SETMASK, &saved_mask, NULL);
+	close(private_pipe[0]);
+	close(private_pipe[1]);
+	if (sigchld_pipe[1] != -1)
+		write(sigchld_pipe[1], "", 1); // children of other jobs may have exited meanwhile
+	return SUCCESS;
 }
-// QUESTION 6 HELPER METHOD END //
+// PARALLEL HELPER METHODS END //
+
+
+// HELPER POOL METHODS START //
+
+//helpers N keeps N prewarmed copies of the shell that run the builtin stages of pipelines
+//and background jobs (highlight, kdiff, concatenate, shortdir) instead of forking for every
+//stage. $SEASHELL_HELPERS=N starts them with the shell, helpers 0 stops them and helpers
+//alone lists them. a request is one SOCK_SEQPACKET message: the words of the stage, with
+//its stdin, stdout and working directory passed as SCM_RIGHTS, and the helper answers with
+//the status and rusage of the builtin. the shell moves a busy helper into the process group
+//of the job like a forked stage so ^C and ^Z reach it, and turns the answer into a wait
+//status for job_update. a helper never leads a job, with job control the first stage is
+//forked so the job's group does not outlive it, and idle helpers wait in a group of their
+//own that is led by a process doing nothing else. a helper that dies in a job is reaped with the job, its slot is
+//emptied when its socket reads as closed and filled again by a later request. helpers that
+//were let go while idle are reaped by the pool itself.
+//the helpers live on between requests, so their shortdir index, kdiff digests and PATH
+//table stay warm
+#define HELPER_MESSAGE_MAX 65536
+
+struct helper
+{
+	pid_t pid; // 0 when the slot is empty
+	int fd;	   // the shell's end of the socketpair
+	bool busy;
+	unsigned long served;
+};
+
+struct helper_reply
+{
+	int status;
+	struct rusage usage;
+};
+
+struct
+{
+	struct helper *slots;
+	int count;
+	pid_t *retired; // let go while idle and not reaped yet, no job waits for them
+	int retired_count;
+	pid_t leader; // leads the process group of idle helpers, 0 when there is none
+	int leader_fd; // the leader exits when it reads the end of this pipe
+} helper_pool;
+
+static const char *helper_builtins[] = {"highlight", "kdiff", "concatenate", "shortdir", NULL};
+
+bool helper_eligible(struct command_t *command){
+	if (helper_pool.count == 0 || command->subshell)
+		return false;
+	for (int i = 0; helper_builtins[i]; i++)
+		if (strcmp(command->name, helper_builtins[i]) == 0)
+			return true;
+	return false;
+}
+
+//the loop of a helper process, requests are served until the shell closes the socket
+void helper_main(int fd){
+	reset_child_signals();
+	job_control = false;
+	// a helper can be started while a pipeline is being set up and never execs,
+	// the pipe ends it inherited would keep the readers of a stage from their end of file
+	helper_close_inherited(fd);
+	sigchld_pipe[0] = sigchld_pipe[1] = -1;
+	helper_pool.count = 0; // the sockets and the leader's pipe are closed already
+	helper_pool.leader = 0;
+	helper_pool_detach(); // a helper never hands work on
+	int null_fd = open("/dev/null", O_RDWR | O_CLOEXEC);
+	dup2(null_fd, STDIN_FILENO);
+	dup2(null_fd, STDOUT_FILENO);
+
+	// the caches the builtins would otherwise fill on their first call
+	shortdir_refresh();
+	if (shortdir.index_dirty)
+		shortdir_build_index();
+	hash_cache_refresh();
+	path_dirs_refresh();
+
+	char *buf = malloc(HELPER_MESSAGE_MAX);
+	char **words = malloc(sizeof(char *) * (HELPER_MESSAGE_MAX / 2 + 1));
+	while (1)
+	{
+		union {
+			struct cmsghdr header;
+			char data[CMSG_SPACE(3 * sizeof(int))];
+		} control;
+		struct iovec iov = {buf, HELPER_MESSAGE_MAX - 1};
+		struct msghdr msg = {.msg_iov = &iov, .msg_iovlen = 1, .msg_control = &control, .msg_controllen = sizeof(control)};
+		ssize_t n = recvmsg(fd, &msg, MSG_CMSG_CLOEXEC);
+		if (n == -1 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			_exit(0);
+		struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+		if (cmsg == NULL || cmsg->cmsg_type != SCM_RIGHTS || cmsg->cmsg_len != CMSG_LEN(3 * sizeof(int)))
+			_exit(1);
+		int fds[3];
+		memcpy(fds, CMSG_DATA(cmsg), sizeof(fds));
+
+		// the message holds the NUL terminated words of the stage
+		int count = 0;
+		buf[n] = 0;
+		for (char *w = buf; w < buf + n; w += strlen(w) + 1)
+			words[count++] = w;
+		words[count] = NULL;
+		struct command_t command;
+		memset(&command, 0, sizeof(command));
+		command.name = words[0];
+		command.args = words + 1;
+		command.arg_count = count - 1;
+
+		fchdir(fds[2]);
+		dup2(fds[0], STDIN_FILENO);
+		dup2(fds[1], STDOUT_FILENO);
+		for (int i = 0; i < 3; i++)
+			close(fds[i]);
+
+		struct rusage before, after;
+		struct helper_reply reply;
+		getrusage(RUSAGE_SELF, &before);
+		last_status = 0;
+		run_builtin(&command);
+		fflush(stdout);
+		getrusage(RUSAGE_SELF, &after);
+		// the readers of the pipe see its end before the shell sees the answer
+		dup2(null_fd, STDIN_FILENO);
+		dup2(null_fd, STDOUT_FILENO);
+		reply.status = last_status;
+		rusage_delta(&reply.usage, &before, &after);
+		if (send(fd, &reply, sizeof(reply), MSG_NOSIGNAL) == -1)
+			_exit(0);
+	}
+}
+
+//closes every fd above stderr except keep
+void helper_close_inherited(int keep){
+	if (close_range(3, keep - 1, 0) == 0 && close_range(keep + 1, ~0U, 0) == 0)
+		return;
+	long max = sysconf(_SC_OPEN_MAX);
+	for (int i = 3; i < max; i++)
+		if (i != keep)
+			close(i);
+}
+
+//forks a helper into an empty slot, returns -1 if it could not be started
+int helper_spawn(struct helper *h){
+	int sv[2];
+	if (socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, sv) == -1)
+		return -1;
+	fflush(stdout);
+	pid_t pid = fork();
+	if (pid == 0)
+	{
+		close(sv[0]);
+		helper_main(sv[1]);
+	}
+	close(sv[1]);
+	if (pid == -1)
+	{
+		close(sv[0]);
+		return -1;
+	}
+	helper_park(pid);
+	h->pid = pid;
+	h->fd = sv[0];
+	h->busy = false;
+	h->served = 0;
+	return 0;
+}
+
+//forks the process that leads the group of idle helpers, returns the pgid of
+//that group or 0 when it could not be started
+pid_t helper_pool_group(){
+	if (helper_pool.leader > 0)
+		return helper_pool.leader;
+	int fds[2];
+	if (pipe2(fds, O_CLOEXEC) == -1)
+		return 0;
+	pid_t pid = fork();
+	if (pid == 0)
+	{
+		setpgid(0, 0);
+		helper_close_inherited(fds[0]);
+		char c;
+		while (read(fds[0], &c, 1) == -1 && errno == EINTR)
+			;
+		_exit(0);
+	}
+	close(fds[0]);
+	if (pid == -1)
+	{
+		close(fds[1]);
+		return 0;
+	}
+	setpgid(pid, pid);
+	helper_pool.leader = pid;
+	helper_pool.leader_fd = fds[1];
+	return pid;
+}
+
+//moves an idle helper out of the way of the terminal and of the jobs
+void helper_park(pid_t pid){
+	if (!job_control)
+		return;
+	pid_t pgid = helper_pool_group();
+	if (pgid == 0 || setpgid(pid, pgid) == -1)
+		setpgid(pid, pid);
+}
+
+//forgets a helper, it exits when it reads the end of the socket
+void helper_release(struct helper *h){
+	if (h->pid > 0)
+	{
+		close(h->fd);
+		if (!h->busy)
+		{
+			helper_pool.retired = realloc(helper_pool.retired, sizeof(pid_t) * (helper_pool.retired_count + 1));
+			helper_pool.retired[helper_pool.retired_count++] = h->pid;
+		}
+	}
+	h->pid = 0;
+	h->busy = false;
+}
+
+//reaps the helpers that exited after they were let go, never blocks
+void helper_reap_retired(){
+	for (int i = 0; i < helper_pool.retired_count;)
+	{
+		if (waitpid(helper_pool.retired[i], NULL, WNOHANG) != 0)
+			helper_pool.retired[i] = helper_pool.retired[--helper_pool.retired_count];
+		else
+			i++;
+	}
+}
+
+//starts or stops helpers until there are count of them
+void helper_pool_resize(int count){
+	for (int i = count; i < helper_pool.count; i++)
+		helper_release(&helper_pool.slots[i]);
+	if (count == 0 && helper_pool.leader > 0)
+	{
+		close(helper_pool.leader_fd);
+		helper_pool.retired = realloc(helper_pool.retired, sizeof(pid_t) * (helper_pool.retired_count + 1));
+		helper_pool.retired[helper_pool.retired_count++] = helper_pool.leader;
+		helper_pool.leader = 0;
+	}
+	if (count > helper_pool.count)
+	{
+		helper_pool.slots = realloc(helper_pool.slots, sizeof(struct helper) * count);
+		for (int i = helper_pool.count; i < count; i++)
+		{
+			helper_pool.slots[i].pid = 0;
+			helper_spawn(&helper_pool.slots[i]);
+		}
+	}
+	helper_pool.count = count;
+}
+
+//hands a builtin stage to an idle helper, returns its pid like a started stage
+//or -1 when the stage has to be forked after all
+pid_t helper_launch(struct command_t *command, int in_fd, int out_fd, pid_t pgid){
+	// the leader of a job's group would take the idle helper with it into a later ^C or ^Z
+	if (pgid == 0)
+		return -1;
+	char *buf = malloc(HELPER_MESSAGE_MAX);
+	size_t len = 0;
+	for (int i = -1; i < command->arg_count; i++)
+	{
+		const char *word = i < 0 ? command->name : command->args[i];
+		size_t n = strlen(word) + 1;
+		if (len + n >= HELPER_MESSAGE_MAX)
+		{
+			free(buf);
+			return -1;
+		}
+		memcpy(buf + len, word, n);
+		len += n;
+	}
+
+	int cwd_fd = open(".", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	if (cwd_fd == -1)
+	{
+		free(buf);
+		return -1;
+	}
+	int fds[3] = {in_fd, out_fd, cwd_fd};
+	union {
+		struct cmsghdr header;
+		char data[CMSG_SPACE(sizeof(fds))];
+	} control;
+	memset(&control, 0, sizeof(control));
+	struct iovec iov = {buf, len};
+	struct msghdr msg = {.msg_iov = &iov, .msg_iovlen = 1, .msg_control = &control, .msg_controllen = sizeof(control)};
+	struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+	cmsg->cmsg_level = SOL_SOCKET;
+	cmsg->cmsg_type = SCM_RIGHTS;
+	cmsg->cmsg_len = CMSG_LEN(sizeof(fds));
+	memcpy(CMSG_DATA(cmsg), fds, sizeof(fds));
+
+	// an idle helper, or a new one in the slot of one that died
+	// a helper that died while idle is only noticed when the request can not be sent
+	pid_t pid = -1;
+	for (int attempt = 0; attempt <= helper_pool.count && pid == -1; attempt++)
+	{
+		struct helper *h = NULL;
+		for (int i = 0; i < helper_pool.count && h == NULL; i++)
+			if (helper_pool.slots[i].pid > 0 && !helper_pool.slots[i].busy)
+				h = &helper_pool.slots[i];
+		for (int i = 0; i < helper_pool.count && h == NULL; i++)
+			if (helper_pool.slots[i].pid == 0 && helper_spawn(&helper_pool.slots[i]) == 0)
+				h = &helper_pool.slots[i];
+		if (h == NULL)
+			break;
+		if (pgid != -1)
+			setpgid(h->pid, pgid);
+		if (sendmsg(h->fd, &msg, MSG_NOSIGNAL) == -1)
+		{
+			helper_release(h);
+			continue;
+		}
+		h->busy = true;
+		pid = h->pid;
+	}
+	close(cwd_fd);
+	free(buf);
+	return pid;
+}
+
+int helper_count(){
+	return helper_pool.count;
+}
+
+//forked children of the shell must not talk to the helpers, they answer to the shell only
+void helper_pool_detach(){
+	// a released helper only exits when no process holds its socket anymore
+	for (int i = 0; i < helper_pool.count; i++)
+		if (helper_pool.slots[i].pid > 0)
+			close(helper_pool.slots[i].fd);
+	helper_pool.count = 0;
+	helper_pool.retired_count = 0; // children of the shell, not of this process
+	if (helper_pool.leader > 0)
+		close(helper_pool.leader_fd);
+	helper_pool.leader = 0;
+}
+
+bool helper_is_busy(pid_t pid){
+	for (int i = 0; i < helper_pool.count; i++)
+		if (helper_pool.slots[i].pid == pid && helper_pool.slots[i].busy)
+			return true;
+	return false;
+}
+
+//never blocks: returns the pid of a helper that finished its stage with a wait status
+//in status like wait4, 0 if none did
+pid_t helper_reap(int *status, struct rusage *ru){
+	for (int i = 0; i < helper_pool.count; i++)
+	{
+		struct helper *h = &helper_pool.slots[i];
+		if (h->pid <= 0 || !h->busy)
+			continue;
+		struct helper_reply reply;
+		ssize_t n = recv(h->fd, &reply, sizeof(reply), MSG_DONTWAIT);
+		if (n == -1 && (errno == EAGAIN || errno == EINTR))
+			continue;
+		if (n != sizeof(reply))
+		{
+			helper_release(h); // died, wait4 reports how
+			continue;
+		}
+		h->busy = false;
+		h->served++;
+		helper_park(h->pid);
+		*status = W_EXITCODE(reply.status & 0xff, 0);
+		*ru = reply.usage;
+		return h->pid;
+	}
+	return 0;
+}
+
+//adds the sockets of busy helpers to a poll set, returns how many were added
+int helper_poll_fds(struct pollfd *fds){
+	int n = 0;
+	for (int i = 0; i < helper_pool.count; i++)
+		if (helper_pool.slots[i].pid > 0 && helper_pool.slots[i].busy)
+			fds[n++] = (struct pollfd){.fd = helper_pool.slots[i].fd, .events = POLLIN};
+	return n;
+}
+
+//helpers [count]
+void helper_builtin(struct command_t *command){
+	if (command->arg_count > 0)
+	{
+		int count = atoi(command->args[0]);
+		if (count < 0 || (count == 0 && strcmp(command->args[0], "0") != 0))
+			printf("-%s: helpers: %s: not a number\n", sysname, command->args[0]);
+		else
+			helper_pool_resize(count);
+		return;
+	}
+	if (helper_pool.count == 0)
+		printf("no helpers, start them with helpers N\n");
+	for (int i = 0; i < helper_pool.count; i++)
+	{
+		struct helper *h = &helper_pool.slots[i];
+		if (h->pid > 0)
+			printf("helper %d: pid %d, %s, %lu stages run\n", i, h->pid, h->busy ? "busy" : "idle", h->served);
+		else
+			printf("helper %d: not running\n", i);
+	}
+}
+// HELPER POOL METHODS END //